@@ -169,6 +169,24 @@ migrate_version_keys() {
   esac
 }
 
+# copgvd is shipped once per ABI, like the zygisk libraries. Only the one this device runs is
+# kept; without it (an ABI we do not build) the module simply reads the JSON every time.
+install_copgvd() {
+  case "$ARCH" in
+    arm64) ABI=arm64-v8a ;;
+    arm)   ABI=armeabi-v7a ;;
+    x64)   ABI=x86_64 ;;
+    *)     ABI="" ;;
+  esac
+  if [ -n "$ABI" ] && [ -f "$MODPATH/bin/$ABI/copgvd" ]; then
+    mv -f "$MODPATH/bin/$ABI/copgvd" "$MODPATH/bin/copgvd"
+    chmod 0755 "$MODPATH/bin/copgvd"
+  fi
+  for dir in "$MODPATH"/bin/*/; do
+    [ -d "$dir" ] && rm -rf "$dir"
+  done
+}
+
 check_config_file() {
   if [ ! -f "$CONFIG_FILE" ]; then
       cp "$MODPATH/COPG-VD.json.example" "$CONFIG_FILE"
@@ -270,6 +288,9 @@ migrate_version_keys
 # Safe by default: the version group is only applied if you arm it in the WebUI.
 [ -f "$MODPATH/.spoof.version" ] || echo never > "$MODPATH/.spoof.version"
 
+install_copgvd
+
+chmod 0755 "$MODPATH/post-fs-data.sh"
 chmod 0755 "$MODPATH/service.sh"
 chmod 0755 "$MODPATH/fingerprint-update.sh"
 chmod 0644 "$CONFIG_FILE"
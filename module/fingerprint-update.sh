@@ -41,14 +41,18 @@ CONFIG_PATHS="/data/adb/COPG-VD.json $MODULE_DIR/COPG-VD.json"
 # these devices; only /system/build.prop, and on a custom ROM the fingerprint line in it is
 # stale garbage inherited from the base image - the ro.build.version.* lines are the good part.
 ROM_PROP="/system/build.prop"
-# Never refreshed from upstream, and only applied when the semaphore allows.
-VERSION_FIELDS="ANDROID_VERSION SDK_INT SDK_FULL CODENAME"
+# Never refreshed from upstream, and only applied when the semaphore allows. props.sh is
+# generated from zygisk/props.def; the fallback only matters for a module missing it.
+[ -f "$MODULE_DIR/props.sh" ] && . "$MODULE_DIR/props.sh"
+VERSION_FIELDS="${VERSION_KEYS:-ANDROID_VERSION SDK_INT SDK_FULL CODENAME}"
 SETTINGS_OBJECT="COPG-VD-Settings"
 # Keys the module actually understands - anything else in the object does nothing.
 # One line, deliberately: Android's awk refuses a newline inside a -v assignment ("newline in
 # string ... at source line 1") and the whole program dies. Fedora's gawk accepts it, so this
 # only ever breaks on the device - which is exactly where it matters.
 KNOWN_KEYS="BRAND DEVICE MANUFACTURER MODEL FINGERPRINT PRODUCT BOOTLOADER BOARD HARDWARE DISPLAY ID HOST INCREMENTAL TIMESTAMP PREVIEW_SDK USER SDK_FINGERPRINT UUID SECURITY_PATCH ANDROID_VERSION SDK_INT SDK_FULL CODENAME TAGS TYPE ODM_SKU SKU"
+# Compiles the config into the image the zygisk module maps (see compile_image).
+COPGVD="$MODULE_DIR/bin/copgvd"
 STATE_FILE="/data/adb/$MODULE_ID.update.state"
 LOG_FILE="/data/adb/$MODULE_ID.update.log"
 LOG_MAX=32768
@@ -74,7 +78,9 @@ IDENTITY="BRAND DEVICE MANUFACTURER MODEL PRODUCT"
 KILL_PACKAGES="com.google.android.gms com.google.android.gsf com.google.android.gms.unstable"
 
 BOOT_RETRY_MAX=40          # network attempts at boot ...
-BOOT_RETRY_SLEEP=15        # ... every 15s, so ~10 min of waiting for wifi
+BOOT_RETRY_SLEEP=15        # ... every 15s, so ~10 min of waiting for wifi. With copgvd the
+                           # waiting for a route is done asleep, and only failed downloads
+                           # with a route up cost an attempt and a sleep.
 
 log() {
     echo "[$MODULE_ID] $*"
@@ -200,6 +206,14 @@ effective_version_fields() {
     done
 }
 
+# The zygisk module maps the compiled image instead of parsing the JSON. A stale one is safe -
+# the module notices and reads the JSON - but every write of the config or of the version
+# policy recompiles it, so that fallback stays the exception.
+compile_image() {
+    [ -x "$COPGVD" ] || return 0
+    "$COPGVD" compile >/dev/null 2>&1 || log "could not compile the config image - the module reads the JSON"
+}
+
 # --------------------------------------------------------------------- settings <- json
 # The JSON declares, the flag files are the cache the shell and the zygisk module read.
 sync_settings() {
@@ -217,19 +231,53 @@ sync_settings() {
         esac
     done
 
+    # The one flag that turns something on rather than off.
+    case "$(json_get_raw "$conf" hook_props)" in
+        true)  [ -e "$MODULE_DIR/.hook.props" ] || { : > "$MODULE_DIR/.hook.props"; log "settings: hook_props on"; } ;;
+        false) [ -e "$MODULE_DIR/.hook.props" ] && { rm -f "$MODULE_DIR/.hook.props"; log "settings: hook_props off"; } ;;
+    esac
+
     case "$(json_get_raw "$conf" spoof_version)" in
         never) echo never > "$MODULE_DIR/.spoof.version" ;;
         rom)   echo rom   > "$MODULE_DIR/.spoof.version" ;;
         force) echo rom   > "$MODULE_DIR/.spoof.version"
                log "settings: spoof_version=force in the config is downgraded to 'rom' - arm it in the WebUI" ;;
     esac
+    compile_image
     return 0
 }
 
+# Patches $1 with copgvd: one pass over the file with a real tokenizer, so a brace inside a
+# string is just a character, and every "COPG-VD" object gets the edit. Written atomically,
+# under the label of the file it replaces. 0 = done, 1 = refused (the file stays as it was), 2 = no copgvd that can patch -
+# the awk below is the fallback.
+patch_config() {
+    target="$1"; shift
+    [ -x "$COPGVD" ] || return 2
+    cp -f "$target" "$target.bak" 2>/dev/null
+    "$COPGVD" patch "$target" "$@" >/dev/null 2>&1
+    case $? in
+        0) chmod 0644 "$target" 2>/dev/null
+           chcon u:object_r:system_file:s0 "$target" 2>/dev/null
+           return 0 ;;
+        1) log "copgvd refused to patch $target - left untouched"; return 1 ;;
+    esac
+    return 2
+}
+
 # Rewrites the values of $FIELDS inside the "COPG-VD" object of $1 and nothing else.
 # Values arrive through the environment (COPG_V_<FIELD>) so no quoting can bite.
 write_fields() {
     target="$1"
+    set --
+    for field in $FIELDS; do
+        eval "value=\$COPG_V_$field"
+        [ -n "$value" ] && set -- "$@" -s "$field=$value"
+    done
+    [ -n "$COPG_V_SOURCE" ] && set -- "$@" -t "Strings extracted from=$COPG_V_SOURCE"
+    patch_config "$target" "$@"
+    case $? in 0) return 0 ;; 1) return 1 ;; esac
+
     [ -n "$AWK" ] || { log "no awk available"; return 1; }
     $AWK -v id="$MODULE_ID" -v keys="$FIELDS" -v src="$COPG_V_SOURCE" '
         function depth_of(s,   i, ch, d) {
@@ -305,6 +353,11 @@ write_fields() {
 # still wrote them.
 drop_version_fields() {
     target="$1"
+    set --
+    for field in $VERSION_FIELDS; do set -- "$@" -d "$field"; done
+    patch_config "$target" "$@"
+    case $? in 0) return 0 ;; 1) return 1 ;; esac
+
     [ -n "$AWK" ] || return 1
     $AWK -v id="$MODULE_ID" -v keys="$VERSION_FIELDS" '
         function depth_of(s,   i, ch, d) {
@@ -353,6 +406,7 @@ migrate_version() {
             log "could not clean $target - left untouched"
         fi
     done
+    [ "$mexeu" -eq 0 ] && compile_image
     return $mexeu
 }
 
@@ -545,6 +599,20 @@ analyze() {
     conf=""
     for path in $CONFIG_PATHS; do [ -f "$path" ] && conf="$path" && break; done
     [ -n "$conf" ] || { log "no config file found in: $CONFIG_PATHS"; echo "status: no-config"; return 1; }
+    # copgvd does all of the below in one process, with the module's own parser and policy -
+    # so its verdict is what zygote will do with the file. The checks here are the fallback,
+    # for a module without the binary (or one too old to know "analyze").
+    if [ -x "$COPGVD" ]; then
+        report=$("$COPGVD" analyze "$conf" 2>/dev/null)
+        analyzed=$?
+        case "$report" in
+            *"status: analyze-"*)
+                echo "$report" | while IFS= read -r line; do
+                    case "$line" in status:*) echo "$line" ;; *) log "$line" ;; esac
+                done
+                return $analyzed ;;
+        esac
+    fi
     [ -n "$AWK" ] || { log "no awk available"; echo "status: failed"; return 1; }
     A_RED=0; A_WARN=0
     log "analyzing $conf"
@@ -640,6 +708,7 @@ apply() {
         fi
     done
     [ -n "$written" ] || return 1
+    compile_image
 
     # resetprop and the zygisk spoof must not disagree: re-apply the props right away.
     if [ -e "$MODDIR/.skip.resetprop" ]; then
@@ -661,11 +730,20 @@ apply() {
 }
 
 wait_for_boot() {
+    [ -x "$COPGVD" ] && "$COPGVD" wait boot >/dev/null 2>&1
     while [ "$(getprop sys.boot_completed)" != "1" ]; do
         sleep 5
     done
 }
 
+# 1 = no default route came up within $1 seconds. Without copgvd, or where it cannot listen
+# to netlink, there is no telling: 0, and the download finds out.
+wait_for_network() {
+    [ -x "$COPGVD" ] || return 0
+    "$COPGVD" wait net "$1" >/dev/null 2>&1
+    [ $? -ne 1 ]
+}
+
 already_ran_this_boot() {
     boot_id=$(cat /proc/sys/kernel/random/boot_id 2>/dev/null)
     [ -n "$boot_id" ] || return 1                       # cannot tell: let it run
@@ -719,8 +797,9 @@ case "$MODE" in
         already_ran_this_boot && exit 0
         attempt=1
         while [ "$attempt" -le "$BOOT_RETRY_MAX" ]; do
-            # No connectivity probe: the download itself is the honest test, and wifi can
-            # take minutes to come up after boot_completed.
+            # A route only says trying is not pointless: the download itself is the honest
+            # test, and wifi can take minutes to come up after boot_completed.
+            wait_for_network $(( (BOOT_RETRY_MAX - attempt + 1) * BOOT_RETRY_SLEEP )) || break
             if fetch_remote; then
                 mark_ran_this_boot
                 compare
@@ -738,7 +817,7 @@ case "$MODE" in
             attempt=$((attempt + 1))
             sleep "$BOOT_RETRY_SLEEP"
         done
-        log "gave up after $BOOT_RETRY_MAX attempts, no network"
+        log "gave up waiting for the network"
         exit 1
         ;;
 
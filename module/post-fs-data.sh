@@ -0,0 +1,12 @@
+#!/system/bin/sh
+# Runs before zygote starts.
+
+MODDIR=${0%/*}
+
+# The JSON declares the settings; the flag files are the cache this script, service.sh and the
+# zygisk module read. Synced here, before zygote, so the module never sees last boot's policy.
+[ -f "$MODDIR/fingerprint-update.sh" ] && sh "$MODDIR/fingerprint-update.sh" sync-settings >/dev/null 2>&1
+
+# The zygisk module maps this image instead of parsing the JSON in every process it starts.
+# Best effort: a missing or stale image only means the module reads the JSON, as it always did.
+[ -x "$MODDIR/bin/copgvd" ] && "$MODDIR/bin/copgvd" compile >/dev/null 2>&1
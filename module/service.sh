@@ -9,9 +9,9 @@ ROM_PROP="/system/build.prop"
 # The Android version belongs to the ROM. Telling apps the SDK is newer than the framework
 # really is makes them call APIs that do not exist: Google's apps crash, the device reboots,
 # and it repeats. Softloop, not bootloop - nothing shows up in the boot logs.
-VERSION_KEYS="ANDROID_VERSION SDK_INT SDK_FULL CODENAME"
-# These are derived, never copied from CODENAME (see aplicar_derivados).
-DERIVED_RELCOD="ro.build.version.release_or_codename ro.build.version.release_or_preview_display ro.odm.build.version.release_or_codename ro.odm_dlkm.build.version.release_or_codename ro.product.build.version.release_or_codename ro.system.build.version.release_or_codename ro.system_dlkm.build.version.release_or_codename ro.system_ext.build.version.release_or_codename ro.vendor.build.version.release_or_codename ro.vendor_dlkm.build.version.release_or_codename ro.bootimage.build.version.release_or_codename"
+# VERSION_KEYS, get_prop_mapping and the PROPS_* lists come from props.sh, which the build
+# generates from zygisk/props.def - the same table copgvd is compiled from.
+[ -f "$MODDIR/props.sh" ] && . "$MODDIR/props.sh"
 
 rom_prop() {
     grep -m 1 "^$1=" "$ROM_PROP" 2>/dev/null | cut -d= -f2-
@@ -53,7 +53,7 @@ aplicar_derivados() {
     [ -n "$release" ] || release=$(rom_prop ro.build.version.release)
     if [ "$codename" = "REL" ] || [ -z "$codename" ]; then valor="$release"; else valor="$codename"; fi
     [ -n "$valor" ] || return 0
-    for prop in $DERIVED_RELCOD; do
+    for prop in $PROPS_RELEASE_OR_CODENAME; do
         propreset "$prop" "$valor"
     done
 }
@@ -78,40 +78,16 @@ propreset() {
     return 1
 }
 
-get_prop_mapping() {
-    cat << 'MAPPING'
-USER|ro.build.user
-SDK_FINGERPRINT|ro.build.version.preview_sdk_fingerprint
-PREVIEW_SDK|ro.build.version.preview_sdk
-CODENAME|ro.build.version.all_codenames|ro.build.version.codename
-TAGS|ro.bootimage.build.tags|ro.bootimage.keys|ro.build.keys|ro.build.tags|ro.odm.build.tags|ro.odm.keys|ro.odm_dlkm.build.tags|ro.odm_dlkm.keys|ro.oem.build.tags|ro.oem.keys|ro.product.build.tags|ro.product.keys|ro.system.build.tags|ro.system.keys|ro.system_ext.build.tags|ro.system_ext.keys|ro.vendor.build.tags|ro.vendor.keys|ro.vendor_dlkm.build.tags|ro.vendor_dlkm.keys|ro.system_dlkm.build.tags
-TYPE|ro.bootimage.build.type|ro.build.type|ro.odm.build.type|ro.odm_dlkm.build.type|ro.oem.build.type|ro.product.build.type|ro.system.build.type|ro.system_dlkm.build.type|ro.system_ext.build.type|ro.vendor.build.type|ro.vendor.md_apps.load_type|ro.vendor_dlkm.build.type
-SECURITY_PATCH|ro.build.version.security_patch|ro.system.build.security_patch|ro.vendor.build.security_patch
-TIMESTAMP|ro.build.date.utc|ro.system.build.date.utc|ro.vendor.build.date.utc|ro.system_ext.build.date.utc|ro.vendor_dlkm.build.date.utc|ro.product.build.date.utc|ro.odm.build.date.utc|ro.bootimage.build.date.utc|ro.odm_dlkm.build.date.utc|ro.system_dlkm.build.date.utc
-INCREMENTAL|ro.build.version.incremental|ro.odm.build.version.incremental|ro.product.build.version.incremental|ro.system.build.version.incremental|ro.system_ext.build.version.incremental|ro.vendor.build.version.incremental|ro.vendor_dlkm.build.version.incremental|ro.odm_dlkm.build.version.incremental|ro.system_dlkm.build.version.incremental
-ANDROID_VERSION|ro.build.version.release|ro.odm.build.version.release|ro.product.build.version.release|ro.system.build.version.release|ro.system_ext.build.version.release|ro.vendor.build.version.release|ro.vendor_dlkm.build.version.release|ro.odm_dlkm.build.version.release|ro.system_dlkm.build.version.release
-SDK_INT|ro.build.version.sdk|ro.vendor_dlkm.build.version.sdk|ro.vendor.build.version.sdk|ro.system_ext.build.version.sdk|ro.product.build.version.sdk|ro.system.build.version.sdk|ro.odm.build.version.sdk|ro.odm_dlkm.build.version.sdk|ro.system_dlkm.build.version.sdk
-SDK_FULL|ro.build.version.sdk_full|ro.odm.build.version.sdk_full|ro.product.build.version.sdk_full|ro.system.build.version.sdk_full|ro.system_ext.build.version.sdk_full|ro.vendor_dlkm.build.version.sdk_full|ro.vendor.build.version.sdk_full|ro.odm_dlkm.build.version.sdk_full|ro.system_dlkm.build.version.sdk_full
-BOARD|ro.board.platform|ro.product.board
-BOOTLOADER|ro.bootloader|boot.bootloader|ro.boot.bootloader
-DISPLAY|ro.build.display.id
-HARDWARE|ro.boot.hardware|ro.hardware|ro.soc.model|ro.kernel.androidboot.hardware|ro.boot.hardware.sku
-HOST|ro.build.host
-ID|ro.build.id|ro.odm.build.id|ro.product.build.id|ro.system.build.id|ro.system_ext.build.id|ro.vendor.build.id|ro.vendor_dlkm.build.id|ro.odm_dlkm.build.id|ro.system_dlkm.build.id
-BRAND|Build.BRAND|ro.product.brand|ro.product.odm.brand|ro.product.product.brand|ro.product.system.brand|ro.product.system_ext.brand|ro.product.vendor.brand|ro.product.vendor_dlkm.brand|ro.product.brand_for_attestation|ro.product.odm_dlkm.brand|ro.product.system_dlkm.brand
-MODEL|ro.product.model|ro.product.odm.model|ro.product.product.model|ro.product.system.model|ro.product.system_ext.model|ro.product.vendor.model|ro.product.vendor_dlkm.model|ro.product.cert|ro.mediatek.rsc_name|ro.product.model_for_attestation|ro.product.odm_dlkm.model|ro.product.system_dlkm.model
-PRODUCT|ro.product.name|ro.product.odm.name|ro.product.product.name|ro.product.system.name|ro.product.system_ext.name|ro.product.vendor.name|ro.product.vendor_dlkm.name|ro.boot.rsc|ro.build.product|ro.product.mod_device|ro.boot.product.hardware.sku|ro.product.odm_dlkm.name|ro.product.system_dlkm.name
-DEVICE|ro.product.device|ro.product.odm.device|ro.product.product.device|ro.product.system.device|ro.product.system_ext.device|ro.product.vendor.device|ro.product.vendor_dlkm.device|ro.miui.cust_device|ro.product.marketname|ro.product.odm.marketname|ro.product.product.marketname|ro.product.system.marketname|ro.product.system_ext.marketname|ro.product.vendor.marketname|ro.product.device_for_attestation|ro.product.name_for_attestation|ro.product.odm_dlkm.device|ro.product.system_dlkm.device|ro.quick_start.device_id
-FINGERPRINT|ro.build.fingerprint|ro.odm.build.fingerprint|ro.product.build.fingerprint|ro.system.build.fingerprint|ro.system_ext.build.fingerprint|ro.vendor.build.fingerprint|ro.vendor_dlkm.build.fingerprint|ro.bootimage.build.fingerprint|ro.system_dlkm.build.fingerprint|ro.odm_dlkm.build.fingerprint
-UUID|ro.build.uuid|ro.product.build.uuid
-MANUFACTURER|ro.product.system_ext.manufacturer|ro.product.vendor.manufacturer|ro.product.vendor_dlkm.manufacturer|ro.product.odm.manufacturer|ro.product.product.manufacturer|ro.product.system.manufacturer|ro.fota.oem|ro.product.manufacturer_for_attestation|ro.product.odm_dlkm.manufacturer|ro.product.system_dlkm.manufacturer|ro.soc.manufacturer
-MANUFACTURER|ro.product.manufacturer
-MAPPING
-}
-
 # Re-runnable: fingerprint-update.sh calls "service.sh --props-only" right after refreshing the
 # JSON, so resetprop never disagrees with what the zygisk module will read.
 apply_props() {
+  # copgvd reads the config and the props once and sets every change in one resetprop run.
+  # The loop below is the fallback: no binary for this ABI, or a config it cannot parse.
+  if [ ! -e "$MODDIR/.skip.resetprop" ] && [ -x "$MODDIR/bin/copgvd" ] && [ -n "$bin_resetprop" ] &&
+     "$MODDIR/bin/copgvd" props "$bin_resetprop" >/dev/null 2>&1; then
+    return 0
+  fi
+
   json_content=$(cat "$COPG_VD_JSON")
   getprop_output=$(getprop)
   POLICY_VERSION=$(spoof_version_policy)
@@ -145,12 +121,12 @@ apply_props() {
               fi
           elif [ "$json_key" = "TIMESTAMP" ]; then
               BUILD_DATE="$(LC_ALL=C TZ=UTC date -u -d "@$json_value")"
-              for prop in ro.build.date ro.odm.build.date ro.product.build.date ro.odm_dlkm.build.date ro.system.build.date ro.system_dlkm.build.date ro.system_ext.build.date ro.vendor.build.date ro.vendor_dlkm.build.date; do
+              for prop in $PROPS_BUILD_DATE; do
                   propreset "$prop" "$BUILD_DATE"
               done
           elif [ "$json_key" = "SDK_INT" ]; then
               SDK_FULL="$json_value.0"
-              for prop in ro.build.version.sdk_full ro.odm.build.version.sdk_full ro.product.build.version.sdk_full ro.system.build.version.sdk_full ro.system_ext.build.version.sdk_full ro.vendor_dlkm.build.version.sdk_full ro.vendor.build.version.sdk_full ro.odm_dlkm.build.version.sdk_full ro.system_dlkm.build.version.sdk_full; do
+              for prop in $PROPS_SDK_FULL_FROM_SDK_INT; do
                   propreset "$prop" "$SDK_FULL"
               done
           elif [ "$json_key" = "FINGERPRINT" ]; then
@@ -183,12 +159,13 @@ if [ "$1" = "--props-only" ]; then
     exit 0
 fi
 
-# The JSON declares the settings; the flag files are the cache this script and the zygisk
-# module read. Sync before applying, so a config edited by hand takes effect this boot.
-[ -f "$MODDIR/fingerprint-update.sh" ] && sh "$MODDIR/fingerprint-update.sh" sync-settings >/dev/null 2>&1
+# The settings were already synced from the JSON by post-fs-data.sh, before zygote started.
 
 apply_props
 
+# copgvd sleeps until init sets the prop. The loop then costs one getprop - or polls, for a
+# module without the binary.
+[ -x "$MODDIR/bin/copgvd" ] && "$MODDIR/bin/copgvd" wait boot >/dev/null 2>&1
 until [ "$(getprop sys.boot_completed)" = "1" ]; do
     sleep 2
 done
@@ -772,6 +772,8 @@ async function loadToggleStates() {
         // Used to be a sed on the shipped service.sh, so it was lost on every module update.
         roproductmanufacturerToggle.checked = (await execCommand("[ -e /data/adb/modules/COPG-VD/.skip.manufacturer ] && echo 0 || echo 1")).trim() === "1";
         autoupdateToggle.checked = (await execCommand("[ -e /data/adb/modules/COPG-VD/.skip.autoupdate ] && echo 0 || echo 1")).trim() === "1";
+        // Off unless asked for: the only flag that is set to turn something on.
+        document.getElementById('toggle-hook-props').checked = (await execCommand("[ -e /data/adb/modules/COPG-VD/.hook.props ] && echo 1 || echo 0")).trim() === "1";
         await loadVersionPolicy();
     } catch (error) {
         appendToOutput("Failed to load toggle states: " + error, 'error');
@@ -1197,6 +1199,10 @@ async function saveConfig() {
         } catch (selinuxError) {
             console.warn('Could not set SELinux context:', selinuxError);
         }
+
+        // The zygisk module maps the compiled image and only parses the JSON when it is stale,
+        // so every save recompiles it. Best effort: no copgvd means the JSON is read as before.
+        await execCommand('[ -x /data/adb/modules/COPG-VD/bin/copgvd ] && /data/adb/modules/COPG-VD/bin/copgvd compile >/dev/null 2>&1 || true');
         
         appendToOutput("Config saved", 'info');
     } catch (error) {
@@ -1236,6 +1242,45 @@ async function loadVersionPolicy() {
     }
 }
 
+function showAnalyzeVerdict(status) {
+    switch (status) {
+        case 'analyze-ok':
+            appendToOutput('Config analyzed: nothing to fix', 'success');
+            break;
+        case 'analyze-warn':
+            appendToOutput('Config analyzed: see the [warn] lines above', 'warning');
+            break;
+        default:
+            appendToOutput('Config analyzed: the [RED] lines break the module or the device', 'error');
+    }
+}
+
+// copgvd answers in milliseconds, with the module's own parser, where the updater's shell
+// checks fork dozens of processes. The updater is the fallback: no binary for this ABI, or
+// one from before "analyze".
+async function runAnalyze() {
+    let report = null;
+    try {
+        // "|| true": a red verdict exits 1, which execCommand would reject.
+        report = JSON.parse(await execCommand('/data/adb/modules/COPG-VD/bin/copgvd analyze --json 2>/dev/null || true'));
+    } catch (error) {
+        report = null;
+    }
+    if (!report || !Array.isArray(report.lines)) {
+        await runUpdater('analyze');
+        return;
+    }
+    appendToOutput(`Analyzing ${report.config}...`, 'info');
+    const tags = { ok: '[ok] ', info: '[info] ', warn: '[warn] ', red: '[RED] ' };
+    const types = { ok: 'success', warn: 'warning', red: 'error' };
+    report.lines.forEach(line => appendToOutput(`${tags[line.level] || ''}${line.text}`, types[line.level] || 'info'));
+    if (report.status === 'no-config') {
+        appendToOutput('No COPG-VD.json found to analyze', 'error');
+        return;
+    }
+    showAnalyzeVerdict(report.status);
+}
+
 // Front-end for fingerprint-update.sh: it prints "[COPG-VD] ..." lines plus a final "status:" line.
 async function runUpdater(mode) {
     const script = '/data/adb/modules/COPG-VD/fingerprint-update.sh';
@@ -1272,13 +1317,9 @@ async function runUpdater(mode) {
             renderDeviceList();
             break;
         case 'analyze-ok':
-            appendToOutput('Config analyzed: nothing to fix', 'success');
-            break;
         case 'analyze-warn':
-            appendToOutput('Config analyzed: see the [warn] lines above', 'warning');
-            break;
         case 'analyze-red':
-            appendToOutput('Config analyzed: the [RED] lines break the module or the device', 'error');
+            showAnalyzeVerdict(status);
             break;
         case 'local-newer':
             appendToOutput('Your config is newer than upstream, nothing was changed', 'warning');
@@ -1294,6 +1335,48 @@ async function runUpdater(mode) {
     }
 }
 
+// What the zygisk module cost each process, as its companion recorded it (zygisk/stats.hpp):
+// one tab-separated line per process, times in nanoseconds.
+const STAT_PHASES = ['fetch', 'open', 'parse', 'rom', 'policy', 'resolve', 'write'];
+
+async function showModuleCost() {
+    let raw;
+    try {
+        raw = await execCommand('cat /data/adb/modules/COPG-VD/.cost/stats.old /data/adb/modules/COPG-VD/.cost/stats 2>/dev/null | tail -n 100 || true');
+    } catch (error) {
+        return;
+    }
+    const rows = raw.split('\n').map(line => line.split('\t')).filter(cols => cols.length === 14)
+        .map(cols => ({
+            abi: cols[2],
+            source: cols[3],
+            total: Number(cols[4]),
+            phases: cols.slice(5, 12).map(Number),
+            bytes: Number(cols[12]),
+            fields: Number(cols[13])
+        }));
+    if (!rows.length) {
+        appendToOutput('Module cost: nothing recorded yet - create .trace in the module directory and start an app', 'info');
+        return;
+    }
+
+    const us = ns => `${(ns / 1000).toFixed(ns < 10000 ? 1 : 0)} µs`;
+    const median = values => {
+        const sorted = [...values].sort((a, b) => a - b);
+        const mid = sorted.length >> 1;
+        return sorted.length % 2 ? sorted[mid] : (sorted[mid - 1] + sorted[mid]) / 2;
+    };
+    const breakdown = phases => STAT_PHASES.map((name, i) => phases[i] ? `${name} ${us(phases[i])}` : null)
+        .filter(Boolean).join(', ');
+
+    const last = rows[rows.length - 1];
+    appendToOutput(`Module cost, latest (${last.abi}, from ${last.source}): ${us(last.total)} - ` +
+        `${breakdown(last.phases)}; ${last.bytes} bytes, ${last.fields} fields written`, 'info');
+    const phases = STAT_PHASES.map((_, i) => median(rows.map(row => row.phases[i])));
+    appendToOutput(`Module cost, median of the last ${rows.length}: ${us(median(rows.map(row => row.total)))} - ` +
+        `${breakdown(phases)}`, 'info');
+}
+
 function closeModal(modalId) {
     const modal = document.getElementById(modalId);
     const content = modal.querySelector('.modal-content');
@@ -1427,6 +1510,17 @@ function applyEventListeners() {
             e.target.checked = !isChecked;
         }
     });
+    document.getElementById('toggle-hook-props').addEventListener('click', async (e) => {
+        const isChecked = e.target.checked;
+        try {
+            await execCommand(`${isChecked ? "touch" : "rm -f"} /data/adb/modules/COPG-VD/.hook.props`);
+            await writeSetting('hook_props', isChecked);
+            appendToOutput(isChecked ? "Props served inside apps. Restart an app to see changes" : "Props no longer served inside apps. Restart an app to see changes", isChecked ? 'success' : 'error');
+        } catch (error) {
+            appendToOutput(`Failed to update the prop hooks: ${error}`, 'error');
+            e.target.checked = !isChecked;
+        }
+    });
 
     document.getElementById('select-spoof-version').addEventListener('change', async (e) => {
         const value = e.target.value;
@@ -1451,7 +1545,8 @@ function applyEventListeners() {
 
     document.getElementById('analyze-config').addEventListener('click', async (e) => {
         e.target.classList.add('loading');
-        await runUpdater('analyze');
+        await runAnalyze();
+        await showModuleCost();
         e.target.classList.remove('loading');
     });
     
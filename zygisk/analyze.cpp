@@ -0,0 +1,473 @@
+#include "analyze.hpp"
+#include "image.hpp"
+#include "log.hpp"
+#include "profile.hpp"
+#include "props.hpp"
+#include <json.hpp>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unistd.h>
+
+namespace analyze {
+
+namespace {
+
+using json = nlohmann::json;
+
+constexpr size_t kCodename = fieldOf("CODENAME");
+constexpr size_t kRelease = fieldOf("RELEASE");
+constexpr size_t kSdkInt = fieldOf("SDK_INT");
+constexpr size_t kSdkIntFull = fieldOf("SDK_INT_FULL");
+constexpr size_t kReleaseOrCodename = fieldOf("RELEASE_OR_CODENAME");
+
+const char* tagOf(Level level) {
+    switch (level) {
+        case Level::Note: return "note";
+        case Level::Detail: return "detail";
+        case Level::Ok: return "ok";
+        case Level::Info: return "info";
+        case Level::Warn: return "warn";
+        case Level::Red: return "red";
+    }
+    return "";
+}
+
+const char* policyName(VersionPolicy policy) {
+    switch (policy) {
+        case VersionPolicy::Never: return "never";
+        case VersionPolicy::Rom: return "rom";
+        case VersionPolicy::Force: return "force";
+    }
+    return "";
+}
+
+bool allDigits(std::string_view s) {
+    return !s.empty() && s.find_first_not_of("0123456789") == std::string_view::npos;
+}
+
+// awk -F'[:/]' over brand/product/device:release/id/incremental:type/tags, 1-based.
+std::string_view fingerprintPart(std::string_view fp, size_t n) {
+    for (size_t i = 1; i < n; i++) {
+        const size_t sep = fp.find_first_of(":/");
+        if (sep == std::string_view::npos) return {};
+        fp.remove_prefix(sep + 1);
+    }
+    return fp.substr(0, fp.find_first_of(":/"));
+}
+
+// Midnight UTC of YYYY-MM-DD, or -1.
+int64_t dayOf(std::string_view date) {
+    int y, m, d;
+    char tail;
+    if (date.size() != 10 || std::sscanf(std::string(date).c_str(), "%4d-%2d-%2d%c", &y, &m, &d, &tail) != 3 ||
+        m < 1 || m > 12 || d < 1 || d > 31) {
+        return -1;
+    }
+    struct tm tm{};
+    tm.tm_year = y - 1900;
+    tm.tm_mon = m - 1;
+    tm.tm_mday = d;
+    return static_cast<int64_t>(timegm(&tm));
+}
+
+void say(Report& report, Level level, std::string text) {
+    if (level == Level::Red) report.red++;
+    if (level == Level::Warn) report.warn++;
+    report.lines.push_back({level, std::move(text)});
+}
+
+// props.def's Version rows, each key once.
+std::vector<std::string_view> versionKeys() {
+    std::vector<std::string_view> keys;
+    for (const props::Mapping& m : props::kMappings) {
+        if (m.rule != props::Rule::Version) continue;
+        bool repeat = false;
+        for (std::string_view k : keys) repeat = repeat || k == m.key;
+        if (!repeat) keys.push_back(m.key);
+    }
+    return keys;
+}
+
+bool knownKey(std::string_view key) {
+    for (const BuildField& f : kBuildFields) {
+        if (f.key && key == f.key) return true;
+    }
+    for (const props::Mapping& m : props::kMappings) {
+        if (key == m.key) return true;
+    }
+    return false;
+}
+
+class Audit {
+public:
+    Audit(Report& report, const json& profile, const DeviceInfo& info)
+        : report(report), profile(profile), info(info), rom(readRomVersion()), policy(readVersionPolicy()) {}
+
+    void version();
+    void fingerprint();
+    void dates();
+    void unknownKeys();
+    void applied();
+
+private:
+    Report& report;
+    const json& profile;
+    const DeviceInfo& info;
+    const RomVersion rom;
+    const VersionPolicy policy;
+
+    void say(Level level, std::string text) { analyze::say(report, level, std::move(text)); }
+
+    std::string value(std::string_view key) const {
+        const auto it = profile.find(std::string(key));
+        return it != profile.end() && it->is_string() ? it->get<std::string>() : std::string();
+    }
+
+    // The release and codename the device reports: what got through the policy, else the ROM's.
+    std::string_view release() const { return info.str[kRelease].empty() ? rom.release : info.str[kRelease]; }
+    std::string_view codename() const { return info.str[kCodename].empty() ? rom.codename : info.str[kCodename]; }
+
+    // What the version group actually became, as "<key> <value>" pairs: read back from what
+    // loadProfile() let through, so it is the module's policy and not a copy of it.
+    std::string appliedVersion() const {
+        std::string out;
+        for (std::string_view key : versionKeys()) {
+            const std::string v = value(key);
+            bool through = false;
+            if (key == "CODENAME") through = !info.str[kCodename].empty();
+            if (key == "ANDROID_VERSION") through = !info.str[kRelease].empty();
+            if (key == "SDK_INT") through = info.num[kSdkInt] != 0;
+            if (key == "SDK_FULL" && !v.empty()) {
+                // Indistinguishable from SDK_INT's own SDK_INT_FULL when they agree, and then
+                // it makes no difference which of the two got through.
+                const size_t dot = v.find('.');
+                const int64_t minor = dot == std::string::npos ? 0 : std::atoll(v.c_str() + dot + 1);
+                through = info.num[kSdkIntFull] == std::atoll(v.c_str()) * 100000 + minor;
+            }
+            if (through) out += std::string(key) + " " + v + " ";
+        }
+        return out;
+    }
+};
+
+void Audit::version() {
+    if (rom.sdk == 0) {
+        say(Level::Warn, std::string("could not read ") + rom_prop_file + " - cannot tell what this ROM really is");
+        return;
+    }
+    say(Level::Note, std::string("ROM (from ") + rom_prop_file + "): Android " + rom.release + ", SDK " +
+                     std::to_string(rom.sdk) + ", codename " + rom.codename + " | semaphore: " + policyName(policy));
+
+    bool present = false;
+    for (std::string_view key : versionKeys()) present = present || !value(key).empty();
+    if (!present) {
+        say(Level::Ok, "version group absent from the config - the ROM's own version is used");
+        return;
+    }
+
+    const std::string through = appliedVersion();
+    const std::string sdk = value("SDK_INT");
+    if (allDigits(sdk) && std::atoll(sdk.c_str()) > rom.sdk) {
+        if (info.num[kSdkInt] != 0) {
+            say(Level::Red, "config asks for SDK " + sdk + " on a framework that is SDK " + std::to_string(rom.sdk) +
+                            ", and the semaphore is letting it through - this is the softloop");
+        } else {
+            say(Level::Warn, "config carries SDK " + sdk + " (> ROM " + std::to_string(rom.sdk) +
+                             ") but the semaphore blocks it - dead weight, safe to delete");
+        }
+    }
+    const std::string cod = value("CODENAME");
+    if (!cod.empty() && cod != rom.codename) {
+        if (!info.str[kCodename].empty()) {
+            say(Level::Red, "config asks for codename '" + cod + "' while the ROM is '" + rom.codename +
+                            "' and the semaphore is letting it through");
+        } else {
+            say(Level::Warn, "config carries codename '" + cod + "' (ROM is '" + rom.codename + "') but the semaphore blocks it");
+        }
+    }
+    if (!through.empty()) say(Level::Detail, "applied by the semaphore: " + through);
+}
+
+// The fingerprint is not free text: it carries six of the other fields inside it.
+void Audit::fingerprint() {
+    const std::string fp = value("FINGERPRINT");
+    if (fp.empty()) {
+        say(Level::Warn, "no FINGERPRINT in the config");
+        return;
+    }
+    static constexpr struct {
+        const char* key;
+        size_t part;
+    } kInside[] = {{"BRAND", 1}, {"PRODUCT", 2}, {"DEVICE", 3}, {"ID", 5}, {"INCREMENTAL", 6}};
+    for (const auto& in : kInside) {
+        const std::string inside(fingerprintPart(fp, in.part));
+        const std::string outside = value(in.key);
+        if (!outside.empty() && outside != inside) {
+            say(Level::Red, std::string("FINGERPRINT says ") + in.key + "='" + inside + "' but the config says '" + outside +
+                            "' - one of them was edited alone");
+        }
+    }
+
+    // Segment 4 is release_or_codename, so it has to match what the device will actually
+    // report - which is what the policy lets through, not what the config asks for.
+    const std::string_view relcod = fingerprintPart(fp, 4);
+    const std::string_view cod = codename();
+    const std::string reports(info.str[kReleaseOrCodename].empty() ? (cod.empty() || cod == "REL" ? release() : cod)
+                                                                   : info.str[kReleaseOrCodename]);
+    if (!reports.empty() && relcod != reports) {
+        say(Level::Info, "FINGERPRINT carries ':" + std::string(relcod) + "/' and this device reports '" + reports +
+                         "'. Deliberate: that segment is release_or_codename, so a preview build always says a word "
+                         "where a release says a number. Matching it would mean a target build of the same Android "
+                         "version; rewriting it would break attestation");
+    } else {
+        say(Level::Ok, "FINGERPRINT agrees with the version this device reports");
+    }
+
+    const std::string preview = value("PREVIEW_SDK");
+    if (!preview.empty() && preview != "0" && reports == release()) {
+        say(Level::Info, "PREVIEW_SDK=" + preview + " comes from the spoofed preview build while the device reports a release one (" +
+                         std::string(release()) + "). Kept on purpose");
+    }
+}
+
+void Audit::dates() {
+    // The build date is the .YYMMDD. inside ID.
+    const std::string id = value("ID");
+    const std::string patch = value("SECURITY_PATCH");
+    std::string day;
+    for (size_t dot = id.find('.'); dot != std::string::npos && day.empty(); dot = id.find('.', dot + 1)) {
+        if (id.size() > dot + 7 && id[dot + 7] == '.' && allDigits(std::string_view(id).substr(dot + 1, 6))) day = id.substr(dot + 1, 6);
+    }
+    if (day.empty() || patch.empty()) {
+        say(Level::Ok, "dates: nothing to compare");
+        return;
+    }
+    const std::string build = "20" + day.substr(0, 2) + "-" + day.substr(2, 2) + "-" + day.substr(4, 2);
+    const int64_t built = dayOf(build);
+    const int64_t patched = dayOf(patch);
+    if (built < 0 || patched < 0) {
+        say(Level::Ok, "dates: cannot convert them, skipped");
+        return;
+    }
+    const int64_t apart = (patched - built) / 86400;
+    if (apart < -60 || apart > 60) {
+        say(Level::Warn, "security patch (" + patch + ") is " + std::to_string(apart) + "d away from the build date (" + build +
+                         ") - real builds ship within a couple of months");
+    } else {
+        say(Level::Ok, "security patch (" + patch + ") fits the build date (" + build + "), " + std::to_string(apart) + "d apart");
+    }
+}
+
+void Audit::unknownKeys() {
+    std::string unknown;
+    for (const auto& item : profile.items()) {
+        if (!knownKey(item.key())) unknown += item.key() + " ";
+    }
+    if (!unknown.empty()) {
+        say(Level::Warn, "keys the module does not read (typos do nothing, silently): " + unknown);
+    } else {
+        say(Level::Ok, "every key in the object is one the module understands");
+    }
+}
+
+// Not just the fingerprint: every prop copgvd props would set, against what it holds now.
+void Audit::applied() {
+    if (access(skip_resetprop_file, F_OK) == 0) {
+        say(Level::Warn, "resetprop is off - the props keep the ROM's values (the zygisk side still spoofs)");
+        return;
+    }
+    props::Plan plan;
+    if (!props::plan(report.config.c_str(), plan)) {
+        say(Level::Info, "the props cannot be read from here - not compared");
+    } else if (!plan.changes.empty()) {
+        say(Level::Warn, std::to_string(plan.changes.size()) + " props do not carry what the config asks for yet (" +
+                         plan.changes.front().name + (plan.changes.size() > 1 ? ", ..." : "") +
+                         ") - reboot, or resetprop failed");
+    } else {
+        say(Level::Ok, "props already carry what the config asks for");
+    }
+}
+
+// The package map against the profiles it names: a process whose profile is missing or
+// broken quietly gets "COPG-VD", which is exactly what nobody notices.
+void packages(Report& report, const json& doc, const char* config) {
+    const auto list = doc.find(exclude_list);
+    if (list != doc.end()) {
+        if (list->is_array()) {
+            say(report, Level::Note, std::to_string(list->size()) + " processes excluded - they see the real Build");
+        } else {
+            say(report, Level::Warn, std::string(exclude_list) + " is not an array - nothing is excluded");
+        }
+    }
+    const auto map = doc.find(packages_object);
+    if (map == doc.end()) return;
+    if (!map->is_object()) {
+        say(report, Level::Warn, std::string(packages_object) + " is not an object - every process gets " + LOG_TAG);
+        return;
+    }
+    std::vector<std::string> checked;
+    size_t mapped = 0;
+    for (const auto& item : map->items()) {
+        if (!item.value().is_string()) {
+            say(report, Level::Warn, item.key() + " is not mapped to a profile name - ignored");
+            continue;
+        }
+        mapped++;
+        const std::string name = item.value().get<std::string>();
+        bool repeat = false;
+        for (const std::string& c : checked) repeat = repeat || c == name;
+        if (repeat) continue;
+        checked.push_back(name);
+        DeviceInfo named;
+        std::string why;
+        if (!loadProfile(config, named, nullptr, &why, Selector{name})) {
+            say(report, Level::Warn, why + " - what is mapped to it gets the default profile");
+        }
+    }
+    say(report, Level::Note, std::to_string(mapped) + " processes mapped to " + std::to_string(checked.size()) +
+                             " profiles in " + profiles_object + " (Build fields only: props stay global)");
+}
+
+} // namespace
+
+const char* Report::status() const {
+    if (!found) return "no-config";
+    if (red > 0) return "analyze-red";
+    return warn > 0 ? "analyze-warn" : "analyze-ok";
+}
+
+Report run(const char* config) {
+    Report report;
+    report.config = config;
+    io::MappedFile file;
+    if (!file.open(config)) return report;
+    report.found = true;
+    // The module's own parser first: when it refuses the file, the module logs one line to
+    // logcat and spoofs NOTHING, and the rest of the analysis would be noise.
+    DeviceInfo info;
+    std::string why;
+    if (!loadProfile(config, info, nullptr, &why)) {
+        say(report, Level::Red, "the module cannot read this file (" + why + ") - it will not spoof at all");
+        return report;
+    }
+    // The module steps over what it does not use; the WebUI and the updater parse it all.
+    const json doc = json::parse(file.data(), file.data() + file.size(), nullptr, false);
+    if (doc.is_discarded()) {
+        say(report, Level::Red, "the file is not valid JSON - the module still finds its profile, but the WebUI and the updater cannot edit it");
+        return report;
+    }
+    // What is audited is what the module uses by default: the active profile, else the one
+    // the hardware matches, else "COPG-VD".
+    Routing routing;
+    readRouting(config, routing);
+    const Hardware hw = routing.rules.empty() ? Hardware() : readHardware();
+    const DefaultPick pick = defaultPick(routing, hw);
+    const std::string matched(pick.matched);
+
+    std::string active = LOG_TAG;
+    const auto base = doc.is_object() ? doc.find(LOG_TAG) : doc.end();
+    const json* profile = base != doc.end() ? &*base : nullptr;
+    const auto library = doc.is_object() ? doc.find(profiles_object) : doc.end();
+    auto choose = [&](const std::string& wanted, const std::string& by_what, const std::string& next) {
+        const bool listed = library != doc.end() && library->is_object();
+        const auto entry = listed ? library->find(wanted) : doc.end();
+        DeviceInfo named;
+        std::string broken;
+        if (listed && entry != library->end() && entry->is_object() &&
+            loadProfile(config, named, nullptr, &broken, Selector{wanted})) {
+            profile = &*entry;
+            active = "\"" + wanted + "\" of " + profiles_object + by_what;
+            return true;
+        }
+        if (!broken.empty()) {
+            say(report, Level::Warn, broken + " - " + next + " is used instead");
+        } else {
+            say(report, Level::Warn, "\"" + wanted + "\"" + by_what + " is no profile in " + profiles_object + " - " + next + " is used");
+        }
+        return false;
+    };
+    const std::string fallback = matched.empty() ? LOG_TAG : "\"" + matched + "\"";
+    bool chosen = false;
+    if (!pick.active.empty()) chosen = choose(std::string(pick.active), std::string(", named by ") + active_key, fallback);
+    if (!chosen && !matched.empty()) choose(matched, std::string(", matched by ") + hwKeyName(pick.by), LOG_TAG);
+    if (!profile || !profile->is_object()) {
+        say(report, Level::Red, std::string("no \"") + LOG_TAG + "\" object - the module has nothing to spoof");
+        return report;
+    }
+    say(report, Level::Ok, "the module's parser reads the file");
+    if (!routing.rules.empty()) {
+        std::string seen;
+        for (size_t k = 0; k < static_cast<size_t>(HwKey::Count); k++) {
+            const HwKey key = static_cast<HwKey>(k);
+            seen += std::string(seen.empty() ? "" : ", ") + hwKeyName(key) + " " + (hw[key].empty() ? "(unknown)" : hw[key]);
+        }
+        say(report, Level::Note, "this device: " + seen);
+        if (matched.empty()) {
+            say(report, Level::Info, std::to_string(routing.rules.size()) + " rules in " + match_object + ", none fits this device");
+        }
+    }
+    if (active != LOG_TAG) say(report, Level::Note, "active profile: " + active);
+
+    // What zygote maps before it ever looks at the JSON. Only ever about the default config.
+    if (std::string_view(config) == config_file) {
+        image::Mapping mapped;
+        if (mapped.open(image_file)) {
+            say(report, Level::Ok, "the compiled image is current - zygote maps it instead of parsing the JSON");
+            const image::Header& h = *mapped.get();
+            const image::PropSlot* props = image::propsOf(h, h.base);
+            uint32_t served = 0;
+            for (uint32_t i = 0; props && i < h.base.props.slots; i++) served += props[i].name != image::kEmpty;
+            if (served > 0) {
+                say(report, Level::Note, std::to_string(served) + " props served inside apps on the default profile, " +
+                                             "each mapped profile's own elsewhere (" + hook_props_file + ")");
+            } else if (access(hook_props_file, F_OK) == 0) {
+                say(report, Level::Warn, "props are to be served inside apps, but the image has none - apps read the real props");
+            }
+        } else if (access(image_file, F_OK) == 0) {
+            say(report, Level::Warn, "the compiled image is stale or damaged - zygote parses the JSON instead (run: copgvd compile)");
+        }
+    }
+
+    Audit audit(report, *profile, info);
+    audit.version();
+    audit.fingerprint();
+    audit.dates();
+    audit.unknownKeys();
+    audit.applied();
+    packages(report, doc, config);
+    return report;
+}
+
+std::string toText(const Report& report) {
+    if (!report.found) return "no config file found at " + report.config + "\nstatus: no-config\n";
+    std::string out = "analyzing " + report.config + "\n";
+    for (const Line& line : report.lines) {
+        switch (line.level) {
+            case Level::Note: out += "  "; break;
+            case Level::Detail: out += "         "; break;
+            case Level::Ok: out += "  [ok]   "; break;
+            case Level::Info: out += "  [info] "; break;
+            case Level::Warn: out += "  [warn] "; break;
+            case Level::Red: out += "  [RED]  "; break;
+        }
+        out += line.text + "\n";
+    }
+    // Stopped at the parser: see run().
+    if (report.red > 0 && report.lines.size() == 1) out += "the file cannot be read - the rest of the analysis would be noise\n";
+    out += std::to_string(report.red) + " red, " + std::to_string(report.warn) + " warn\n";
+    return out + "status: " + report.status() + "\n";
+}
+
+std::string toJson(const Report& report) {
+    json::array_t lines;
+    for (const Line& line : report.lines) lines.push_back({{"level", tagOf(line.level)}, {"text", line.text}});
+    const json out = {{"config", report.config}, {"status", report.status()}, {"red", report.red},
+                      {"warn", report.warn}, {"lines", std::move(lines)}};
+    return out.dump(-1, ' ', false, json::error_handler_t::replace) + "\n";
+}
+
+} // namespace analyze
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// fingerprint-update.sh's audit of the config, answered by the code that actually reads it:
+// the module's own parser, version policy and prop plan, so the verdict is what zygote and
+// copgvd props will do with the file rather than what grep makes of it.
+namespace analyze {
+
+// Ok: nothing to say. Info: deliberate and permanent, reported and never counted.
+// Warn: incoherent but deliberate or harmless. Red: breaks the device, or silently disables
+// the whole module. Note and Detail are context, not verdicts.
+enum class Level { Note, Detail, Ok, Info, Warn, Red };
+
+struct Line {
+    Level level;
+    std::string text;
+};
+
+struct Report {
+    std::string config;
+    bool found = false;
+    std::vector<Line> lines;
+    int red = 0;
+    int warn = 0;
+
+    // The updater's "status:" word: no-config, analyze-red, analyze-warn or analyze-ok.
+    const char* status() const;
+};
+
+Report run(const char* config);
+
+// The lines fingerprint-update.sh used to log, then its "status:" line.
+std::string toText(const Report& report);
+// {"config", "status", "red", "warn", "lines": [{"level", "text"}]}, for the WebUI.
+std::string toJson(const Report& report);
+
+} // namespace analyze
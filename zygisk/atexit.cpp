@@ -26,17 +26,37 @@
  * SUCH DAMAGE.
  */
 
+#include <atomic>
+#include <cstdint>
 #include <cstdlib>
 #include <pthread.h>
 
 namespace {
     struct AtexitEntry {
-        void (*fn)(void *);  // the __cxa_atexit callback
-        void *arg;          // argument for `fn` callback
+        std::atomic<void (*)(void *)> fn;   // the __cxa_atexit callback; null once consumed
+        void *arg;                          // argument for `fn` callback
+        void *dso;                          // the __dso_handle it was registered for
     };
 
-    AtexitEntry *g_array = nullptr;
-    size_t capacity = 8;
+    // The common case never touches the heap - this runs inside zygote. Registration claims
+    // an inline slot with one atomic bump; only once they are all taken does it fall back to
+    // a malloc'd overflow array under the mutex.
+    constexpr uint32_t kInline = 32;
+    AtexitEntry g_inline[kInline];
+
+    // Low half: slots claimed. High half: slots whose entry is fully written. Kept in one
+    // word so that finalize can tell "nothing in flight" and reset both in a single CAS.
+    std::atomic<uint64_t> g_inline_state{0};
+    constexpr uint64_t kPublished = uint64_t{1} << 32;
+
+    struct OverflowEntry {
+        void (*fn)(void *);
+        void *arg;
+        void *dso;
+    };
+
+    OverflowEntry *g_array = nullptr;
+    size_t capacity = 0;
     size_t count = 0;
     pthread_mutex_t g_atexit_mutex = PTHREAD_MUTEX_INITIALIZER;
     inline void atexit_lock() {
@@ -47,68 +67,115 @@ namespace {
         pthread_mutex_unlock(&g_atexit_mutex);
     }
 
+    int overflow_add(void (*func)(void *), void *arg, void *dso) {
+        atexit_lock();
+        if (count >= capacity) [[unlikely]] {
+            const size_t new_capacity = capacity ? capacity * 2 : 8;
+            auto *grown = reinterpret_cast<OverflowEntry*>(
+                    realloc(g_array, new_capacity * sizeof(OverflowEntry)));
+            if (!grown) {           // realloc keeps the old block: do not leak it
+                atexit_unlock();
+                return -1;
+            }
+            g_array = grown;
+            capacity = new_capacity;
+        }
+        g_array[count++] = {func, arg, dso};
+        atexit_unlock();
+        return 0;
+    }
+
+    inline bool matches(void *entry_dso, void *dso) {
+        return dso == nullptr || entry_dso == dso;
+    }
+
+    // Under the mutex. Takes the newest live entry for `dso` out of the table, overflow first:
+    // everything in it was registered after the inline slots ran out.
+    bool take_last(void *dso, OverflowEntry &out) {
+        for (size_t i = count; i-- > 0;) {
+            if (g_array[i].fn == nullptr || !matches(g_array[i].dso, dso)) continue;
+            out = g_array[i];
+            g_array[i] = {};
+            if (i == count - 1) count--;
+            return true;
+        }
+        const uint64_t state = g_inline_state.load(std::memory_order_acquire);
+        const uint32_t claimed = static_cast<uint32_t>(state);
+        for (uint32_t i = claimed < kInline ? claimed : kInline; i-- > 0;) {
+            AtexitEntry &slot = g_inline[i];
+            // A slot still being written has no fn yet and is skipped, like any empty one.
+            if (slot.fn.load(std::memory_order_acquire) == nullptr || !matches(slot.dso, dso)) continue;
+            auto *fn = slot.fn.exchange(nullptr, std::memory_order_acq_rel);
+            if (fn == nullptr) continue;
+            out = {fn, slot.arg, slot.dso};
+            return true;
+        }
+        return false;
+    }
+
+    // Under the mutex, once a finalize has drained what it could. Empty tables go back to
+    // their initial state so that the next registrations start over - the overflow array
+    // freed and null again, the inline slots reusable. The inline slots only once the
+    // overflow is empty as well: take_last() holds everything in it for newer than they are.
+    void reset_if_empty() {
+        while (count > 0 && g_array[count - 1].fn == nullptr) count--;
+        if (count != 0) return;
+        free(g_array);
+        g_array = nullptr;          // a later __cxa_atexit must allocate again, not write freed memory
+        capacity = 0;
+
+        uint64_t state = g_inline_state.load(std::memory_order_acquire);
+        const uint32_t claimed = static_cast<uint32_t>(state);
+        if (claimed != static_cast<uint32_t>(state >> 32)) return;     // a registration in flight
+        for (uint32_t i = 0; i < claimed && i < kInline; i++) {
+            if (g_inline[i].fn.load(std::memory_order_acquire) != nullptr) return;
+        }
+        // Fails, harmlessly, if anything was claimed since the load above.
+        g_inline_state.compare_exchange_strong(state, 0, std::memory_order_acq_rel);
+    }
+
     // Register a function to be called either when a library is unloaded (dso != nullptr), or when the
     // program exits (dso == nullptr). The `dso` argument is typically the address of a hidden
     // __dso_handle variable. This function is also used as the backend for the atexit function.
     //
     // See https://itanium-cxx-abi.github.io/cxx-abi/abi.html#dso-dtor.
     //
-    extern "C" [[gnu::used]] int __cxa_atexit(void (*func)(void *), void *arg, void * /* dso */) { // NOLINT(bugprone-reserved-identifier)
-        int result = -1;
+    extern "C" [[gnu::used]] int __cxa_atexit(void (*func)(void *), void *arg, void *dso) { // NOLINT(bugprone-reserved-identifier)
+        if (func == nullptr) return -1;
 
-        if (func != nullptr) {
-            atexit_lock();
-            if (!g_array) {
-                g_array = reinterpret_cast<AtexitEntry*>(malloc(capacity * sizeof(AtexitEntry)));
-                if (!g_array) {
-                    atexit_unlock();
-                    return -1;
-                }
-            }
-            if (count >= capacity) [[unlikely]] {
-                const size_t new_capacity = capacity * 2;
-                auto *grown = reinterpret_cast<AtexitEntry*>(
-                        realloc(g_array, new_capacity * sizeof(AtexitEntry)));
-                if (!grown) {           // realloc keeps the old block: do not leak it
-                    atexit_unlock();
-                    return -1;
-                }
-                g_array = grown;
-                capacity = new_capacity;
-            }
-            g_array[count].fn = func;
-            g_array[count].arg = arg;
-            count++;
-            result = 0;
-            atexit_unlock();
+        const uint32_t slot = static_cast<uint32_t>(g_inline_state.fetch_add(1, std::memory_order_acq_rel));
+        if (slot < kInline) [[likely]] {
+            AtexitEntry &entry = g_inline[slot];
+            entry.arg = arg;
+            entry.dso = dso;
+            entry.fn.store(func, std::memory_order_release);
+            g_inline_state.fetch_add(kPublished, std::memory_order_release);
+            return 0;
         }
-
+        // A claim past the end still counts as published, or the slots could never be reset -
+        // but only once its entry is in the overflow, so no reset slips in between and lets a
+        // newer inline entry run after it.
+        const int result = overflow_add(func, arg, dso);
+        g_inline_state.fetch_add(kPublished, std::memory_order_release);
         return result;
     }
 
     // This function will be called by __on_dlclose, which is a destructor of dso
     // https://cs.android.com/android/platform/superproject/main/+/main:bionic/libc/arch-common/bionic/crtbegin_so.c;l=34;drc=5501003be73b73de59044b44b12f6e20ba6e0021
-    extern "C" [[gnu::used]] void __cxa_finalize(void * /* dso */) { // NOLINT(bugprone-reserved-identifier)
+    // Runs the entries of `dso` - all of them for nullptr - newest first, and only those.
+    extern "C" [[gnu::used]] void __cxa_finalize(void *dso) { // NOLINT(bugprone-reserved-identifier)
         atexit_lock();
-        // Pop from the end and shrink `count` as we go. Consuming the entry (instead of only
-        // blanking it) is what keeps this safe: an entry registered by a callback is picked up
-        // by the next iteration, a recursive __cxa_finalize drains what is left and finds an
-        // empty array on return, and there is no index left to run backwards past zero.
-        while (count > 0) {
-            const AtexitEntry entry = g_array[count - 1];
-            g_array[count - 1] = {};
-            count--;
-
-            if (entry.fn == nullptr) continue;
-
+        // Take one entry at a time, newest first, and consume it before running it. That is
+        // what keeps this safe: an entry registered by a callback is picked up by the next
+        // search, a recursive __cxa_finalize drains what is left and finds nothing on
+        // return, and there is no index to run backwards past zero.
+        OverflowEntry entry;
+        while (take_last(dso, entry)) {
             atexit_unlock();
             entry.fn(entry.arg);
             atexit_lock();
         }
-
-        free(g_array);
-        g_array = nullptr;      // a later __cxa_atexit must allocate again, not write freed memory
-        capacity = 8;
+        reset_if_empty();
         atexit_unlock();
     }
 }
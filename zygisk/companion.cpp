@@ -0,0 +1,223 @@
+#include "companion.hpp"
+#include "image.hpp"
+#include "io.hpp"
+#include "log.hpp"
+#include "trace.hpp"
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <fcntl.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+namespace companion {
+
+namespace {
+
+// Long enough for a companion that has to parse; short enough that a wedged one does not
+// hold up an app launch.
+constexpr int kTimeoutMs = 500;
+// How long the companion waits for the module's stats before it gives up on them.
+constexpr int kReportTimeoutMs = 2000;
+
+bool writeFull(int fd, const void* data, size_t len) {
+    auto p = static_cast<const char*>(data);
+    while (len) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        len -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// Every input of the image, and copgvd's image itself, is watched through its directory, not the file itself: the
+// scripts and the WebUI replace files by renaming over them, which a file watch misses.
+class Watch {
+public:
+    // false when inotify is not available; the caller then checks the stamps instead.
+    bool start() {
+        fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd < 0) return false;
+        for (const char* path : {config_file, version_policy_file, rom_prop_file, vendor_prop_file, hook_props_file,
+                                 image_file}) {
+            const char* slash = strrchr(path, '/');
+            const std::string dir(path, slash - path);
+            inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE | IN_ATTRIB);
+        }
+        return true;
+    }
+
+    bool active() const { return fd >= 0; }
+
+    // Drains what has queued up since the last call. true if any of it touched an input.
+    bool changed() {
+        alignas(inotify_event) char buf[4096];
+        bool hit = false;
+        ssize_t n;
+        while ((n = read(fd, buf, sizeof(buf))) > 0) {
+            for (char* p = buf; p < buf + n;) {
+                auto ev = reinterpret_cast<inotify_event*>(p);
+                if (ev->mask & IN_Q_OVERFLOW) hit = true;
+                if (ev->len && isInput(ev->name)) hit = true;
+                p += sizeof(inotify_event) + ev->len;
+            }
+        }
+        return hit;
+    }
+
+private:
+    int fd = -1;
+
+    static bool isInput(const char* name) {
+        for (const char* path : {config_file, version_policy_file, rom_prop_file, vendor_prop_file, hook_props_file,
+                                 image_file}) {
+            if (!strcmp(name, strrchr(path, '/') + 1)) return true;
+        }
+        return false;
+    }
+};
+
+// `lock` is held to check the inputs and to swap the image, never across a build or a
+// write to a client: those work on a snapshot of `current`.
+std::mutex lock;
+Watch watch;
+bool watching = false;
+std::shared_ptr<const std::vector<char>> current;  // null until built; empty when the config did not resolve
+unsigned generation = 0;                           // of the newest build started
+unsigned installed = 0;                            // of the build in `current`
+
+// Under `lock`. Whether `current` still matches its inputs.
+bool upToDate() {
+    if (!watching) {
+        watching = true;
+        watch.start();              // before the first build: a change during it is not lost
+        return false;
+    }
+    if (!current) return false;
+    if (watch.active()) return !watch.changed();
+    const image::Header* h = image::check(current->data(), current->size());
+    return h && image::isCurrent(*h);
+}
+
+// copgvd's own image when it is current: the same bytes, plus the prop tables only copgvd
+// can plan.
+std::shared_ptr<const std::vector<char>> build() {
+    auto out = std::make_shared<std::vector<char>>();
+    image::Mapping compiled;
+    if (compiled.open(image_file)) {
+        const char* data = reinterpret_cast<const char*>(compiled.get());
+        out->assign(data, data + compiled.size());
+    } else if (!image::build(config_file, *out)) {
+        out->clear();
+    }
+    return out;
+}
+
+// The image to serve. A connection that comes in while another rebuilds gets the previous
+// one; of two builds racing, the one started last is kept.
+std::shared_ptr<const std::vector<char>> snapshot() {
+    unsigned mine;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (upToDate()) return current;
+        mine = ++generation;
+    }
+    auto next = build();
+    std::lock_guard<std::mutex> guard(lock);
+    if (mine > installed) {
+        installed = mine;
+        current = std::move(next);
+    }
+    return current;
+}
+
+std::mutex stats_lock;
+std::atomic<bool> recorded{false};
+
+// The first process, then only while tracing: one access() per connection instead of a
+// record, and the wait for it, on every app start.
+bool wantReport() {
+    return !recorded.load() || access(trace_flag_file, F_OK) == 0;
+}
+
+// The stats file is rotated, not trimmed: at this size the WebUI's median has plenty of
+// history in the two files together.
+constexpr off_t kStatsMax = 64 * 1024;
+
+void record(const Stats& s) {
+    static constexpr const char* kSources[] = {"none", "companion", "image", "json"};
+    const size_t source = static_cast<size_t>(s.source);
+    char line[512];
+    int n = snprintf(line, sizeof(line), "%s\t%d\t%s\t%s\t%llu", io::bootId(), s.pid, COPGVD_ABI,
+                     source < std::size(kSources) ? kSources[source] : "none",
+                     static_cast<unsigned long long>(s.total_ns));
+    for (uint64_t ns : s.ns) {
+        n += snprintf(line + n, sizeof(line) - n, "\t%llu", static_cast<unsigned long long>(ns));
+    }
+    n += snprintf(line + n, sizeof(line) - n, "\t%u\t%u\n", s.bytes, s.fields);
+
+    std::lock_guard<std::mutex> guard(stats_lock);
+    mkdir(stats_dir, 0755);
+    struct stat st;
+    if (stat(stats_file, &st) == 0 && st.st_size > kStatsMax) {
+        const std::string old = std::string(stats_file) + ".old";
+        rename(stats_file, old.c_str());
+    }
+    int fd = open(stats_file, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) return;
+    if (writeFull(fd, line, static_cast<size_t>(n))) recorded = true;
+    close(fd);
+}
+
+} // namespace
+
+void serve(int client) {
+    const bool report = wantReport();
+    const auto image = snapshot();
+    const uint32_t len = static_cast<uint32_t>(image->size());
+    const uint32_t head = len | (report ? kReport : 0);
+    if (!writeFull(client, &head, sizeof(head)) || (len && !writeFull(client, image->data(), len))) return;
+    if (!report) return;
+    // This waits for the module to finish applying.
+    timeval tv{kReportTimeoutMs / 1000, (kReportTimeoutMs % 1000) * 1000};
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    Stats stats;
+    if (io::readFull(client, &stats, sizeof(stats)) == sizeof(stats)) record(stats);
+}
+
+Client::~Client() {
+    if (fd >= 0) close(fd);
+}
+
+bool Client::fetch(std::vector<char>& blob) {
+    if (fd < 0) return false;
+    timeval tv{kTimeoutMs / 1000, (kTimeoutMs % 1000) * 1000};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    uint32_t len = 0;
+    if (io::readFull(fd, &len, sizeof(len)) != sizeof(len)) return false;
+    wanted = len & kReport;
+    len &= ~kReport;
+    if (len == 0 || len > (1u << 20)) return false;
+    blob.resize(len);
+    return io::readFull(fd, blob.data(), len) == len;
+}
+
+void Client::report(const Stats& stats) {
+    if (fd < 0) return;
+    if (wanted) writeFull(fd, &stats, sizeof(stats));
+    close(fd);
+    fd = -1;
+}
+
+} // namespace companion
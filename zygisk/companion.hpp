@@ -0,0 +1,48 @@
+#pragma once
+
+#include "stats.hpp"
+#include <cstdint>
+#include <vector>
+
+// The root companion: one process per ABI that resolves the config once and hands the
+// result - a compiled image, copgvd's own when it is current - to every process that asks.
+// The module asks only when copgvd's image is stale or missing, or while tracing.
+// It keeps the image in memory and rebuilds it only when inotify says one of its inputs
+// changed, so a config change costs one parse per ABI instead of one per process.
+//
+// Wire format: a native-endian uint32_t length, then that many bytes of image. A length
+// of 0 means the companion could not resolve the config; the reason is in its log. With
+// kReport set in the length, the module answers with its Stats once it is done, whichever
+// way it got the profile, and the companion records them. It asks the first process it
+// serves - one record per ABI each time zygote starts - and every process while
+// trace_flag_file exists; the others it lets go without waiting for them.
+
+namespace companion {
+
+constexpr uint32_t kReport = 1u << 31;
+
+// Root side: answers one connection. Zygisk may call it on several threads at once.
+void serve(int client);
+
+// Module side, around the fd connectCompanion() returned (-1 is fine: no companion).
+class Client {
+public:
+    explicit Client(int fd) : fd(fd) {}
+    Client(const Client&) = delete;
+    Client& operator=(const Client&) = delete;
+    ~Client();
+
+    // The companion's image. false when there is no companion or no usable answer, which
+    // sends the module to the JSON.
+    bool fetch(std::vector<char>& blob);
+
+    // Best effort, and the end of the conversation. Sends nothing unless the companion
+    // asked for it.
+    void report(const Stats& stats);
+
+private:
+    int fd;
+    bool wanted = false;
+};
+
+} // namespace companion
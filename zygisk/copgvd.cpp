@@ -0,0 +1,161 @@
+// copgvd: the root-side half of the module, run from the boot scripts and the WebUI.
+//
+//   copgvd compile [config] [image]   resolve the config and write the compiled image, with
+//                                      the props to hook when .hook.props is there
+//   copgvd props [-n] RESETPROP        set the props the config maps, in one resetprop run;
+//                                      -n only prints what would change
+//   copgvd patch FILE [-s KEY=VALUE]... [-d KEY]... [-t KEY=VALUE]...
+//                                      rewrite values in place: -s in the "COPG-VD" object
+//                                      (added when missing), -d dropped from it, -t top level
+//   copgvd analyze [--json] [config]   audit the config as the module reads it; exit 1 on a red
+//   copgvd wait boot|net [SECONDS]     block until boot completes / a default route exists;
+//                                      exit 1 on timeout, 3 when it cannot wait here at all
+//
+// Never loaded into zygote, so it is free to allocate, print and take its time.
+
+#include "analyze.hpp"
+#include "events.hpp"
+#include "image.hpp"
+#include "patch.hpp"
+#include "log.hpp"
+#include "profile.hpp"
+#include "props.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <unistd.h>
+
+static int usage() {
+    std::fprintf(stderr, "usage: copgvd compile [config] [image]\n"
+                         "       copgvd props [-n] RESETPROP\n"
+                         "       copgvd patch FILE [-s KEY=VALUE]... [-d KEY]... [-t KEY=VALUE]...\n"
+                         "       copgvd analyze [--json] [config]\n"
+                         "       copgvd wait boot|net [SECONDS]\n");
+    return 2;
+}
+
+static int cmdCompile(int argc, char** argv) {
+    const char* config = argc > 0 ? argv[0] : config_file;
+    const char* out = argc > 1 ? argv[1] : image_file;
+    // The props the module serves when it hooks them, for the default profile and each one a
+    // process is mapped to: exactly what resetprop would set, or already holds, for that
+    // profile. Without them the image is still good for Build.
+    image::PropTables tables;
+    const bool hook = access(hook_props_file, F_OK) == 0;
+    if (hook) {
+        Routing routing;
+        readRouting(config, routing);
+        tables[{}];
+        for (const auto& [process, profile] : routing.profiles) {
+            if (!profile.empty()) tables[profile];
+        }
+        for (auto& [profile, table] : tables) {
+            props::Plan plan;
+            if (!props::plan(config, plan, profile)) continue;
+            for (const props::Change& c : plan.changes) table.emplace_back(c.name, c.value);
+            for (const props::Change& c : plan.held) table.emplace_back(c.name, c.value);
+        }
+        if (tables[{}].empty()) ERROR_LOG("%s: no props to hook in the image", config);
+    }
+    if (!image::compile(config, out, hook ? &tables : nullptr)) return 1;
+    std::printf("compiled %s -> %s\n", config, out);
+    return 0;
+}
+
+static int cmdProps(int argc, char** argv) {
+    const bool dry_run = argc > 0 && !std::strcmp(argv[0], "-n");
+    if (dry_run) {
+        argc--;
+        argv++;
+    }
+    if (!dry_run && argc < 1) return usage();
+    if (!dry_run && props::upToDate()) {
+        std::printf("props up to date\n");
+        return 0;
+    }
+    props::Plan plan;
+    if (!props::plan(config_file, plan)) return 1;
+    if (dry_run) {
+        for (const props::Change& c : plan.changes) std::printf("%s=%s\n", c.name.c_str(), c.value.c_str());
+        return 0;
+    }
+    if (!props::apply(argv[0], plan)) {
+        props::forget();
+        return 1;
+    }
+    props::record(plan);
+    std::printf("%zu props set\n", plan.changes.size());
+    return 0;
+}
+
+static int cmdPatch(int argc, char** argv) {
+    if (argc < 1) return usage();
+    const char* path = argv[0];
+    patch::Edits edits;
+    for (int i = 1; i < argc; i++) {
+        const char* flag = argv[i];
+        if (i + 1 >= argc) return usage();
+        const char* arg = argv[++i];
+        if (!std::strcmp(flag, "-d")) {
+            edits.drop.emplace_back(arg);
+            continue;
+        }
+        const char* eq = std::strchr(arg, '=');
+        if (!eq || eq == arg) return usage();
+        std::pair<std::string, std::string> kv(std::string(arg, eq), std::string(eq + 1));
+        if (!std::strcmp(flag, "-s")) {
+            edits.set.push_back(std::move(kv));
+        } else if (!std::strcmp(flag, "-t")) {
+            edits.top.push_back(std::move(kv));
+        } else {
+            return usage();
+        }
+    }
+    return patch::file(path, LOG_TAG, edits) ? 0 : 1;
+}
+
+static int cmdAnalyze(int argc, char** argv) {
+    const bool as_json = argc > 0 && !std::strcmp(argv[0], "--json");
+    if (as_json) {
+        argc--;
+        argv++;
+    }
+    const analyze::Report report = analyze::run(argc > 0 ? argv[0] : config_file);
+    const std::string out = as_json ? analyze::toJson(report) : analyze::toText(report);
+    std::fwrite(out.data(), 1, out.size(), stdout);
+    return !report.found || report.red > 0 ? 1 : 0;
+}
+
+// Distinct from a timeout: the scripts fall back to polling on anything but 0 and 1, which
+// also covers an older copgvd that answers "wait" with its usage.
+static constexpr int kCannotWait = 3;
+
+static int cmdWait(int argc, char** argv) {
+    if (argc < 1) return usage();
+    const int timeout = argc > 1 ? std::atoi(argv[1]) : 0;
+    events::Wait result;
+    if (!std::strcmp(argv[0], "boot")) {
+        result = events::property("sys.boot_completed", "1", timeout);
+    } else if (!std::strcmp(argv[0], "net")) {
+        result = events::defaultRoute(timeout);
+    } else {
+        return usage();
+    }
+    switch (result) {
+        case events::Wait::Done: return 0;
+        case events::Wait::Timeout: return 1;
+        case events::Wait::Failed: break;
+    }
+    return kCannotWait;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) return usage();
+    if (!std::strcmp(argv[1], "compile")) return cmdCompile(argc - 2, argv + 2);
+    if (!std::strcmp(argv[1], "props")) return cmdProps(argc - 2, argv + 2);
+    if (!std::strcmp(argv[1], "patch")) return cmdPatch(argc - 2, argv + 2);
+    if (!std::strcmp(argv[1], "analyze")) return cmdAnalyze(argc - 2, argv + 2);
+    if (!std::strcmp(argv[1], "wait")) return cmdWait(argc - 2, argv + 2);
+    return usage();
+}
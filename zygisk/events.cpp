@@ -0,0 +1,157 @@
+#include "events.hpp"
+#include "io.hpp"
+#include "log.hpp"
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <poll.h>
+#include <sys/socket.h>
+#ifdef __ANDROID__
+#include <sys/system_properties.h>
+#endif
+
+namespace events {
+
+namespace {
+
+int64_t nowMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+// No deadline at all when the timeout is not positive.
+class Deadline {
+public:
+    explicit Deadline(int timeout_s) : at(timeout_s > 0 ? nowMs() + int64_t{timeout_s} * 1000 : -1) {}
+
+    // Milliseconds left: -1 for no deadline, 0 once it has passed.
+    int left() const {
+        if (at < 0) return -1;
+        const int64_t ms = at - nowMs();
+        return ms > 0 ? static_cast<int>(ms) : 0;
+    }
+
+    // What __system_property_wait takes: nullptr for no deadline.
+    const struct timespec* relative(struct timespec& ts) const {
+        const int ms = left();
+        if (ms < 0) return nullptr;
+        ts.tv_sec = ms / 1000;
+        ts.tv_nsec = static_cast<long>(ms % 1000) * 1000000;
+        return &ts;
+    }
+
+private:
+    int64_t at;
+};
+
+bool requestRoutes(int fd) {
+    struct {
+        struct nlmsghdr header;
+        struct rtmsg route;
+    } request{};
+    request.header.nlmsg_len = sizeof(request);
+    request.header.nlmsg_type = RTM_GETROUTE;
+    request.header.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    request.header.nlmsg_seq = 1;
+    request.route.rtm_family = AF_UNSPEC;
+    return send(fd, &request, sizeof(request), 0) == static_cast<ssize_t>(sizeof(request));
+}
+
+bool isDefault(const struct nlmsghdr* msg) {
+    if (msg->nlmsg_type != RTM_NEWROUTE || msg->nlmsg_len < NLMSG_LENGTH(sizeof(struct rtmsg))) return false;
+    const auto* route = static_cast<const struct rtmsg*>(NLMSG_DATA(msg));
+    return route->rtm_dst_len == 0 && route->rtm_type == RTN_UNICAST &&
+           (route->rtm_family == AF_INET || route->rtm_family == AF_INET6);
+}
+
+} // namespace
+
+Wait property(const char* name, const char* value, int timeout_s) {
+#ifdef __ANDROID__
+    const Deadline deadline(timeout_s);
+    struct timespec ts;
+    uint32_t global = 0;
+    for (;;) {
+        const prop_info* pi = __system_property_find(name);
+        if (!pi) {
+            // Not there yet: any prop being added or changed wakes this up to look again.
+            if (deadline.left() == 0 || !__system_property_wait(nullptr, global, &global, deadline.relative(ts))) {
+                return Wait::Timeout;
+            }
+            continue;
+        }
+        struct Current {
+            char value[PROP_VALUE_MAX];
+            uint32_t serial;
+        } now{};
+        __system_property_read_callback(pi, [](void* cookie, const char*, const char* v, uint32_t serial) {
+            auto* c = static_cast<Current*>(cookie);
+            strlcpy(c->value, v, sizeof(c->value));
+            c->serial = serial;
+        }, &now);
+        if (!std::strcmp(now.value, value)) return Wait::Done;
+        // Against the serial the value was read with: a change in between returns at once.
+        uint32_t serial;
+        if (deadline.left() == 0 || !__system_property_wait(pi, now.serial, &serial, deadline.relative(ts))) {
+            return Wait::Timeout;
+        }
+    }
+#else
+    (void)name;
+    (void)value;
+    (void)timeout_s;
+    ERROR_LOG("No system properties to wait on on this platform");
+    return Wait::Failed;
+#endif
+}
+
+Wait defaultRoute(int timeout_s) {
+    const Deadline deadline(timeout_s);
+    io::UniqueFd fd(socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE));
+    // Subscribed before asking for the table, so a route added in between is not missed.
+    struct sockaddr_nl addr{};
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = RTMGRP_IPV4_ROUTE | RTMGRP_IPV6_ROUTE;
+    if (!fd || bind(fd.get(), reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        !requestRoutes(fd.get())) {
+        ERROR_LOG("rtnetlink: %s", strerror(errno));
+        return Wait::Failed;
+    }
+
+    alignas(struct nlmsghdr) char buf[32768];
+    for (;;) {
+        struct pollfd pfd{fd.get(), POLLIN, 0};
+        const int ready = poll(&pfd, 1, deadline.left());
+        if (ready == 0) return Wait::Timeout;
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            ERROR_LOG("poll: %s", strerror(errno));
+            return Wait::Failed;
+        }
+        const ssize_t n = recv(fd.get(), buf, sizeof(buf), 0);
+        if (n < 0) {
+            // Events came faster than they were read and some were dropped: ask again.
+            if (errno == ENOBUFS && requestRoutes(fd.get())) continue;
+            if (errno == EINTR) continue;
+            ERROR_LOG("rtnetlink: %s", strerror(errno));
+            return Wait::Failed;
+        }
+        size_t len = static_cast<size_t>(n);
+        for (auto* msg = reinterpret_cast<struct nlmsghdr*>(buf); NLMSG_OK(msg, len); msg = NLMSG_NEXT(msg, len)) {
+            if (isDefault(msg)) return Wait::Done;
+            if (msg->nlmsg_type == NLMSG_ERROR && msg->nlmsg_len >= NLMSG_LENGTH(sizeof(struct nlmsgerr))) {
+                const int error = -static_cast<const struct nlmsgerr*>(NLMSG_DATA(msg))->error;
+                if (error != 0) {
+                    ERROR_LOG("rtnetlink: %s", strerror(error));
+                    return Wait::Failed;
+                }
+            }
+        }
+    }
+}
+
+} // namespace events
@@ -0,0 +1,18 @@
+#pragma once
+
+// What the boot scripts used to poll for, waited on instead: the process sleeps in the kernel
+// until the thing happens, with no getprop or wget forked every few seconds to ask.
+namespace events {
+
+enum class Wait { Done, Timeout, Failed };
+
+// Until the prop holds `value`. A prop that does not exist yet is waited for as well.
+// timeout_s <= 0 waits for as long as it takes. Failed when there is no property area.
+Wait property(const char* name, const char* value, int timeout_s);
+
+// Until the kernel has a default route, in any table: Android keeps one table per network,
+// so "main" is not where it is. Done right away when there already is one. A route is not
+// a working connection - it only means that trying now is not pointless.
+Wait defaultRoute(int timeout_s);
+
+} // namespace events
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <string_view>
+
+// One row per android.os.Build / Build.VERSION field the module may write. The row is the
+// whole definition: which JSON key feeds the field, how its fieldID is resolved and which
+// setter writes it. Its position is its slot in DeviceInfo, ProfileView and the compiled
+// image - which records a hash of this table, so editing it just makes old images stale.
+enum class Kind : uint8_t { Str, Int, Long };
+enum class Cls : uint8_t { Build, Version, Count };
+
+static constexpr const char* kClassNames[] = {"android/os/Build", "android/os/Build$VERSION"};
+
+struct BuildField {
+    const char* key;        // JSON key copied in as it is; nullptr when the module derives it
+    Cls cls;
+    const char* name;
+    const char* sig;
+    Kind kind;
+};
+
+static constexpr BuildField kBuildFields[] = {
+    {"BRAND", Cls::Build, "BRAND", "Ljava/lang/String;", Kind::Str},
+    {"DEVICE", Cls::Build, "DEVICE", "Ljava/lang/String;", Kind::Str},
+    {"MANUFACTURER", Cls::Build, "MANUFACTURER", "Ljava/lang/String;", Kind::Str},
+    {"MODEL", Cls::Build, "MODEL", "Ljava/lang/String;", Kind::Str},
+    {"FINGERPRINT", Cls::Build, "FINGERPRINT", "Ljava/lang/String;", Kind::Str},
+    {"PRODUCT", Cls::Build, "PRODUCT", "Ljava/lang/String;", Kind::Str},
+    {"BOARD", Cls::Build, "BOARD", "Ljava/lang/String;", Kind::Str},
+    {"BOOTLOADER", Cls::Build, "BOOTLOADER", "Ljava/lang/String;", Kind::Str},
+    {"HARDWARE", Cls::Build, "HARDWARE", "Ljava/lang/String;", Kind::Str},
+    {"ID", Cls::Build, "ID", "Ljava/lang/String;", Kind::Str},
+    {"DISPLAY", Cls::Build, "DISPLAY", "Ljava/lang/String;", Kind::Str},
+    {"HOST", Cls::Build, "HOST", "Ljava/lang/String;", Kind::Str},
+    {"ODM_SKU", Cls::Build, "ODM_SKU", "Ljava/lang/String;", Kind::Str},      // else PRODUCT
+    {"SKU", Cls::Build, "SKU", "Ljava/lang/String;", Kind::Str},              // else HARDWARE
+    {"USER", Cls::Build, "USER", "Ljava/lang/String;", Kind::Str},
+    {nullptr, Cls::Build, "TAGS", "Ljava/lang/String;", Kind::Str},           // release-keys
+    {nullptr, Cls::Build, "TYPE", "Ljava/lang/String;", Kind::Str},           // user
+    {nullptr, Cls::Build, "TIME", "J", Kind::Long},                            // TIMESTAMP, in ms
+    {"INCREMENTAL", Cls::Version, "INCREMENTAL", "Ljava/lang/String;", Kind::Str},
+    {"SECURITY_PATCH", Cls::Version, "SECURITY_PATCH", "Ljava/lang/String;", Kind::Str},
+    // The version group: only what the policy lets through, see loadProfile().
+    {nullptr, Cls::Version, "CODENAME", "Ljava/lang/String;", Kind::Str},
+    {nullptr, Cls::Version, "RELEASE", "Ljava/lang/String;", Kind::Str},
+    {nullptr, Cls::Version, "SDK", "Ljava/lang/String;", Kind::Str},
+    {nullptr, Cls::Version, "SDK_INT", "I", Kind::Int},
+    {nullptr, Cls::Version, "SDK_INT_FULL", "I", Kind::Int},
+    {nullptr, Cls::Version, "RELEASE_OR_CODENAME", "Ljava/lang/String;", Kind::Str},
+    {nullptr, Cls::Version, "RELEASE_OR_PREVIEW_DISPLAY", "Ljava/lang/String;", Kind::Str},
+};
+
+static constexpr size_t kFieldCount = std::size(kBuildFields);
+
+// Deliberately never defined: naming a field that is not in the table stops the build.
+size_t unknownBuildField();
+
+// The slot of a Build field, by its Java name. Meant for constants only.
+constexpr size_t fieldOf(std::string_view name) {
+    for (size_t i = 0; i < kFieldCount; i++) {
+        if (name == kBuildFields[i].name) return i;
+    }
+    return unknownBuildField();
+}
+
+// Identifies the table in the compiled image, so a build with other rows never trusts it.
+constexpr uint32_t fieldTableHash() {
+    uint32_t hash = 2166136261u;
+    auto mix = [&hash](std::string_view s) {
+        for (char c : s) hash = (hash ^ static_cast<unsigned char>(c)) * 16777619u;
+        hash = (hash ^ 0xFFu) * 16777619u;
+    };
+    for (const BuildField& f : kBuildFields) {
+        mix(kClassNames[static_cast<size_t>(f.cls)]);
+        mix(f.name);
+        mix(f.sig);
+    }
+    return hash;
+}
@@ -0,0 +1,357 @@
+#include "image.hpp"
+#include "io.hpp"
+#include "log.hpp"
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+
+namespace image {
+
+uint32_t fnv1a32(const void* data, size_t len, uint32_t hash) {
+    auto p = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < len; i++) hash = (hash ^ p[i]) * 16777619u;
+    return hash;
+}
+
+uint64_t fnv1a64(const void* data, size_t len) {
+    auto p = static_cast<const unsigned char*>(data);
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < len; i++) hash = (hash ^ p[i]) * 1099511628211ull;
+    return hash;
+}
+
+static bool readAll(const char* path, std::vector<char>& out, struct stat* st = nullptr) {
+    io::UniqueFd fd(io::openRead(path));
+    if (!fd) return false;
+    struct stat local;
+    if (fstat(fd.get(), &local) != 0) return false;
+    out.resize(static_cast<size_t>(local.st_size));
+    out.resize(io::readFull(fd.get(), out.data(), out.size()));
+    if (st) *st = local;
+    return true;
+}
+
+// Same bytes, new inode or mtime: a script that rewrote the file with what it already had.
+// Only hashed when the size still matches, which is the one case it can pay off.
+static bool sameContent(const char* config_path, const io::Stamp& now, const Header& h) {
+    if (now.size != h.config.size) return false;
+    io::MappedFile file;
+    if (!file.open(config_path)) return false;
+    return fnv1a64(file.data(), file.size()) == h.config_hash;
+}
+
+namespace {
+
+const uint64_t* bloom(const Header& h) {
+    return reinterpret_cast<const uint64_t*>(&h + 1);
+}
+
+const Record* records(const Header& h) {
+    return reinterpret_cast<const Record*>(bloom(h) + h.bloom_words);
+}
+
+const Slot* slots(const Header& h) {
+    return reinterpret_cast<const Slot*>(records(h) + h.record_count);
+}
+
+const char* propArea(const Header& h) {
+    return reinterpret_cast<const char*>(slots(h) + h.index_slots);
+}
+
+const char* poolOf(const Header& h) {
+    return propArea(h) + h.prop_bytes;
+}
+
+// Every string must end inside the image: NewStringUTF reads straight out of it. The prop
+// table only has to lie within the prop tables; prophook checks its strings when it copies it.
+bool sane(const Record& r, const char* pool, size_t pool_size, uint32_t prop_bytes) {
+    for (size_t f = 0; f < kFieldCount; f++) {
+        if (r.str[f] == kAbsent) continue;
+        if (r.str[f] >= pool_size || !memchr(pool + r.str[f], '\0', pool_size - r.str[f])) return false;
+    }
+    const PropTable& t = r.props;
+    const uint64_t size = uint64_t{t.slots} * sizeof(PropSlot) + t.bytes;
+    return (t.slots & (t.slots - 1)) == 0 && t.offset % 8 == 0 && t.bytes % 8 == 0 && (t.slots != 0 || t.bytes == 0) &&
+           t.offset <= prop_bytes && size <= prop_bytes - t.offset;
+}
+
+// Two bits in one word, so a name that is not in the index costs one load. The hash is
+// remixed first: the index already takes its low bits.
+struct BloomBits {
+    uint32_t word;
+    uint64_t mask;
+};
+
+BloomBits bloomBits(uint32_t hash, uint32_t words) {
+    const uint32_t x = hash * 0x9E3779B1u;
+    return {(x >> 12) & (words - 1), (uint64_t{1} << (x & 63)) | (uint64_t{1} << ((x >> 6) & 63))};
+}
+
+} // namespace
+
+const Header* check(const void* data, size_t length) {
+    if (length < sizeof(Header)) return nullptr;
+    auto header = static_cast<const Header*>(data);
+    const Header& h = *header;
+    const uint64_t tables = uint64_t{h.bloom_words} * sizeof(uint64_t) + uint64_t{h.record_count} * sizeof(Record) +
+                            uint64_t{h.index_slots} * sizeof(Slot) + h.prop_bytes;
+    bool ok = h.magic == kMagic && h.version == kVersion && h.header_size == sizeof(Header) &&
+              h.table_hash == fieldTableHash() && h.field_count == kFieldCount &&
+              h.total_size == length && tables <= length - sizeof(Header) &&
+              (h.index_slots & (h.index_slots - 1)) == 0 && (h.bloom_words & (h.bloom_words - 1)) == 0 &&
+              (h.index_slots == 0 || h.bloom_words != 0) && h.prop_bytes % 8 == 0 &&
+              h.checksum == fnv1a32(&h.checksum + 1, length - offsetof(Header, checksum) - sizeof(h.checksum));
+    if (ok) {
+        // The index is checked slot by slot as lookups reach it, not all of it on every fork.
+        const char* pool = poolOf(h);
+        const size_t pool_size = length - sizeof(Header) - tables;
+        ok = sane(h.base, pool, pool_size, h.prop_bytes) && sane(h.real, pool, pool_size, h.prop_bytes);
+        for (uint32_t r = 0; ok && r < h.record_count; r++) ok = sane(records(h)[r], pool, pool_size, h.prop_bytes);
+    }
+    return ok ? header : nullptr;
+}
+
+bool isCurrent(const Header& h, const char* config_path) {
+    if (!io::sameStamp(io::stampOf(version_policy_file), h.policy) ||
+        !io::sameStamp(io::stampOf(rom_prop_file), h.rom) || !io::sameStamp(io::stampOf(vendor_prop_file), h.vendor) ||
+        !io::sameStamp(io::stampOf(hook_props_file), h.hook)) {
+        return false;
+    }
+    const io::Stamp now = io::stampOf(config_path);
+    return now.size != 0 && (io::sameStamp(now, h.config) || sameContent(config_path, now, h));
+}
+
+// The slot of `name`, or nullptr. A slot pointing outside the image matches nothing.
+static const Slot* find(const Header& h, std::string_view name) {
+    if (h.index_slots == 0 || name.empty()) return nullptr;
+    const uint32_t hash = fnv1a32(name.data(), name.size());
+    const BloomBits bits = bloomBits(hash, h.bloom_words);
+    if ((bloom(h)[bits.word] & bits.mask) != bits.mask) return nullptr;
+
+    const char* pool = poolOf(h);
+    const size_t pool_size = h.total_size - static_cast<size_t>(pool - reinterpret_cast<const char*>(&h));
+    const uint32_t mask = h.index_slots - 1;
+    for (uint32_t i = hash & mask, probes = 0; probes < h.index_slots; i = (i + 1) & mask, probes++) {
+        const Slot& slot = slots(h)[i];
+        if (slot.name == kEmpty) return nullptr;
+        if (slot.hash != hash || (slot.record >= h.record_count && slot.record != kExcluded) || slot.name >= pool_size ||
+            pool_size - slot.name <= name.size()) {
+            continue;
+        }
+        const char* at = pool + slot.name;
+        if (!memcmp(at, name.data(), name.size()) && at[name.size()] == '\0') return &slot;
+    }
+    return nullptr;
+}
+
+const Record* recordOf(const Header& h, const char* process) {
+    if (!process) return &h.base;
+    // The process by its full name, then its package: "com.app:remote" is com.app's.
+    const std::string_view name(process);
+    const Slot* slot = find(h, name);
+    if (!slot && name.find(':') != std::string_view::npos) slot = find(h, name.substr(0, name.find(':')));
+    if (slot && slot->record == kExcluded) return &h.real;
+    return slot ? &records(h)[slot->record] : &h.base;
+}
+
+ProfileView viewOf(const Header& h, const char* process) {
+    const Record* record = recordOf(h, process);
+    ProfileView view;
+    const char* pool = poolOf(h);
+    for (size_t f = 0; f < kFieldCount; f++) {
+        if (record->str[f] != kAbsent) view.str[f] = pool + record->str[f];
+        view.num[f] = record->num[f];
+    }
+    return view;
+}
+
+const PropSlot* propsOf(const Header& h, const Record& r) {
+    return r.props.slots ? reinterpret_cast<const PropSlot*>(propArea(h) + r.props.offset) : nullptr;
+}
+
+bool Mapping::open(const char* path, const char* config_path) {
+    header = nullptr;
+    if (file.open(path)) header = check(file.data(), file.size());
+    if (header && !isCurrent(*header, config_path)) header = nullptr;
+    if (!header) file.reset();
+    return header != nullptr;
+}
+
+ProfileView Mapping::view(const char* process) const {
+    return header ? viewOf(*header, process) : ProfileView();
+}
+
+bool build(const char* config_path, std::vector<char>& out, const PropTables* props) {
+    // Stamped before reading: if the JSON changes while we work, the image comes out stale
+    // and the module reads the JSON, instead of the other way round.
+    const io::Stamp policy = io::stampOf(version_policy_file);
+    const io::Stamp rom = io::stampOf(rom_prop_file);
+    const io::Stamp vendor = io::stampOf(vendor_prop_file);
+    const io::Stamp hook = io::stampOf(hook_props_file);
+    std::vector<char> bytes;
+    struct stat st;
+    if (!readAll(config_path, bytes, &st)) {
+        ERROR_LOG("Failed to open: %s", config_path);
+        return false;
+    }
+
+    DeviceInfo info{};
+    if (!loadProfile(config_path, info)) return false;
+
+    Header h{};
+    h.magic = kMagic;
+    h.version = kVersion;
+    h.header_size = sizeof(Header);
+    h.config = io::stampOf(st);
+    h.policy = policy;
+    h.rom = rom;
+    h.hook = hook;
+    h.vendor = vendor;
+    h.config_hash = fnv1a64(bytes.data(), bytes.size());
+    h.table_hash = fieldTableHash();
+    h.field_count = kFieldCount;
+
+    std::string pool;
+    auto fill = [&pool](Record& r, const ProfileView& view) {
+        for (size_t f = 0; f < kStrSlots; f++) {
+            if (f < kFieldCount) r.num[f] = view.num[f];
+            if (f >= kFieldCount || !view.str[f]) {
+                r.str[f] = kAbsent;
+                continue;
+            }
+            r.str[f] = static_cast<uint32_t>(pool.size());
+            pool.append(view.str[f]).push_back('\0');
+        }
+    };
+    // Each profile's props in an open-addressed table at most half full, with strings of its
+    // own so the module can copy the table out in one go. The last value of a prop wins.
+    std::string prop_area;
+    auto propTable = [&prop_area, props](const std::string& profile) {
+        PropTable t{};
+        if (!props) return t;
+        const auto given = props->find(profile);
+        if (given == props->end()) return t;
+        std::map<std::string, std::string> wanted;
+        for (const auto& [name, value] : given->second) {
+            if (!name.empty()) wanted[name] = value;
+        }
+        if (wanted.empty()) return t;
+        t.offset = static_cast<uint32_t>(prop_area.size());
+        t.slots = 1;
+        while (t.slots < wanted.size() * 2) t.slots <<= 1;
+        std::vector<PropSlot> index(t.slots, PropSlot{0, kEmpty, 0, 0});
+        std::string strings;
+        for (const auto& [name, value] : wanted) {
+            const uint32_t hash = propHash(name.c_str(), name.size());
+            uint32_t i = hash & (t.slots - 1);
+            while (index[i].name != kEmpty) i = (i + 1) & (t.slots - 1);
+            index[i] = PropSlot{hash, static_cast<uint32_t>(strings.size()), 0, static_cast<uint32_t>(value.size())};
+            strings.append(name).push_back('\0');
+            index[i].value = static_cast<uint32_t>(strings.size());
+            strings.append(value).push_back('\0');
+        }
+        strings.resize((strings.size() + 7) & ~size_t{7}, '\0');
+        t.bytes = static_cast<uint32_t>(strings.size());
+        prop_area.append(reinterpret_cast<const char*>(index.data()), index.size() * sizeof(PropSlot));
+        prop_area.append(strings);
+        return t;
+    };
+    fill(h.base, viewOf(info));
+    h.base.props = propTable({});
+    // Excluded processes see the real device, props included: no table.
+    DeviceInfo real{};
+    scanRomBuild(real);
+    fill(h.real, viewOf(real));
+
+    // Only the profiles some process is mapped to, each resolved exactly like "COPG-VD". The
+    // last mapping of a process wins, as it would in the DOM; a process mapped to a profile
+    // that is missing or broken - logged by loadProfile() - gets a copy of the default, so
+    // it does not fall through to its package's entry. Exclusion wins over any mapping.
+    Routing routing;
+    readRouting(config_path, routing);
+    std::map<std::string, uint32_t> latest;
+    std::map<std::string, uint32_t> record_of;
+    std::vector<Record> records;
+    for (const auto& [process, profile] : routing.profiles) {
+        if (process.empty()) continue;
+        auto it = record_of.find(profile);
+        if (it == record_of.end()) {
+            DeviceInfo named{};
+            records.emplace_back(h.base);
+            if (loadProfile(config_path, named, nullptr, nullptr, Selector{profile})) {
+                fill(records.back(), viewOf(named));
+                records.back().props = propTable(profile);
+            }
+            it = record_of.emplace(profile, static_cast<uint32_t>(records.size() - 1)).first;
+        }
+        latest[process] = it->second;
+    }
+    for (const std::string& process : routing.excluded) {
+        if (!process.empty()) latest[process] = kExcluded;
+    }
+    if (pool.size() >= kAbsent || prop_area.size() >= kAbsent) {
+        ERROR_LOG("%s: profiles too large for the image", config_path);
+        return false;
+    }
+
+    // Open addressing at most half full, behind a Bloom filter of about 16 bits a name: most
+    // processes are in neither list and stop at the filter.
+    h.record_count = static_cast<uint32_t>(records.size());
+    h.prop_bytes = static_cast<uint32_t>(prop_area.size());
+    h.index_slots = 0;
+    h.bloom_words = 0;
+    if (!latest.empty()) {
+        h.index_slots = 1;
+        while (h.index_slots < latest.size() * 2) h.index_slots <<= 1;
+        h.bloom_words = 1;
+        while (h.bloom_words * 4 < latest.size()) h.bloom_words <<= 1;
+    }
+    std::vector<uint64_t> filter(h.bloom_words);
+    std::vector<Slot> index(h.index_slots, Slot{0, kEmpty, 0});
+    for (const auto& [process, record] : latest) {
+        const uint32_t hash = fnv1a32(process.data(), process.size());
+        const BloomBits bits = bloomBits(hash, h.bloom_words);
+        filter[bits.word] |= bits.mask;
+        uint32_t i = hash & (h.index_slots - 1);
+        while (index[i].name != kEmpty) i = (i + 1) & (h.index_slots - 1);
+        index[i] = Slot{hash, static_cast<uint32_t>(pool.size()), record};
+        pool.append(process).push_back('\0');
+    }
+
+    const size_t tables = filter.size() * sizeof(uint64_t) + records.size() * sizeof(Record) + index.size() * sizeof(Slot) +
+                          prop_area.size();
+    h.total_size = static_cast<uint32_t>(sizeof(Header) + tables + pool.size());
+
+    out.assign(sizeof(Header), '\0');
+    memcpy(out.data(), &h, sizeof(Header));
+    out.insert(out.end(), reinterpret_cast<const char*>(filter.data()),
+               reinterpret_cast<const char*>(filter.data() + filter.size()));
+    out.insert(out.end(), reinterpret_cast<const char*>(records.data()),
+               reinterpret_cast<const char*>(records.data() + records.size()));
+    out.insert(out.end(), reinterpret_cast<const char*>(index.data()),
+               reinterpret_cast<const char*>(index.data() + index.size()));
+    out.insert(out.end(), prop_area.begin(), prop_area.end());
+    out.insert(out.end(), pool.begin(), pool.end());
+    const size_t covered = offsetof(Header, checksum) + sizeof(h.checksum);
+    h.checksum = fnv1a32(out.data() + covered, out.size() - covered);
+    memcpy(out.data() + offsetof(Header, checksum), &h.checksum, sizeof(h.checksum));
+    return true;
+}
+
+bool compile(const char* config_path, const char* image_path, const PropTables* props) {
+    std::vector<char> out;
+    if (!build(config_path, out, props)) return false;
+
+    // Same label the scripts give the JSON, or zygote is not allowed to read it. Not fatal:
+    // there is no SELinux on a host, and on a device an unreadable image only means the JSON.
+    if (!io::replaceFile(image_path, out.data(), out.size(), "u:object_r:system_file:s0")) {
+        ERROR_LOG("Failed to write: %s", image_path);
+        return false;
+    }
+    return true;
+}
+
+} // namespace image
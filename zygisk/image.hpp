@@ -0,0 +1,173 @@
+#pragma once
+
+#include "io.hpp"
+#include "profile.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+// The compiled config: the resolved profiles - version policy and RELEASE_OR_CODENAME already
+// decided - laid out flat so the module can mmap it and apply it with no parser and no heap.
+// copgvd writes it next to the JSON whenever the config changes. It is only a cache: whenever
+// it does not describe the files it was built from, the module reads the JSON as before.
+static constexpr const char* image_file = "/data/adb/COPG-VD.img";
+// Opt-in: while it exists, `copgvd compile` puts the props the config maps into the image
+// and the module serves them to the app's own reads - see prophook.hpp.
+static constexpr const char* hook_props_file = "/data/adb/modules/COPG-VD/.hook.props";
+
+namespace image {
+
+constexpr uint32_t kMagic = 0x44564743;     // "CGVD"
+constexpr uint16_t kVersion = 8;
+constexpr uint32_t kAbsent = 0xFFFFFFFF;
+// Rounded up so the header has no tail padding, which i386 and arm64 would disagree on.
+constexpr size_t kStrSlots = (kFieldCount + 3) & ~size_t{3};
+
+// Where the props of a Record are: `slots` PropSlots at `offset` into the prop tables, then
+// `bytes` of the strings they name. Records of the same profile share one.
+struct PropTable {
+    uint32_t offset;             // a multiple of 8
+    uint32_t slots;              // a power of two, or 0 when the profile has no props
+    uint32_t bytes;              // a multiple of 8
+    uint32_t reserved;
+};
+
+// One resolved profile.
+struct Record {
+    int64_t num[kFieldCount];    // one per kBuildFields row, used by the non-string ones
+    uint32_t str[kStrSlots];     // offset into the pool of a NUL-terminated string, or kAbsent
+    PropTable props;
+};
+
+// One slot of the package index, an open-addressing table keyed by fnv1a32 of the name.
+struct Slot {
+    uint32_t hash;
+    uint32_t name;               // offset into the pool of the process or package name, or kEmpty
+    uint32_t record;             // into the records after the header, or kExcluded: Header::real
+};
+constexpr uint32_t kEmpty = 0xFFFFFFFF;
+constexpr uint32_t kExcluded = 0xFFFFFFFE;
+
+// One slot of the prop table, open addressing keyed by propHash(): four to a cache line.
+// Offsets are into the prop strings, which follow the slots.
+struct PropSlot {
+    uint32_t hash;
+    uint32_t name;               // or kEmpty
+    uint32_t value;
+    uint32_t length;             // of the value, without its NUL
+};
+
+// Written by the 64-bit copgvd and read by both zygotes: fixed-width fields only, widest
+// first, so 32-bit ABIs see the same offsets.
+//
+// The header, `bloom_words` words of a Bloom filter over the names in the index,
+// `record_count` named Records, `index_slots` Slots, `prop_bytes` of prop tables, then the
+// string pool.
+struct Header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t header_size;
+    uint32_t total_size;         // header + records + index + string pool
+    uint32_t checksum;           // FNV-1a of every byte after this field
+    io::Stamp config;            // the JSON it was compiled from
+    io::Stamp policy;            // .spoof.version; all zero if it did not exist
+    io::Stamp rom;               // /system/build.prop
+    uint64_t config_hash;        // FNV-1a of the JSON: a rewrite with the same bytes is not stale
+    uint32_t table_hash;         // fieldTableHash() of the build that wrote it
+    uint32_t field_count;
+    Record base;                 // "COPG-VD": every process the index does not name
+    Record real;                 // scanRomBuild(): every excluded process
+    uint32_t record_count;
+    uint32_t index_slots;        // a power of two, or 0 when no package is mapped
+    uint32_t bloom_words;        // a power of two when index_slots is not 0
+    uint32_t prop_bytes;         // every record's PropTable, a multiple of 8
+    uint32_t reserved[2];
+    io::Stamp hook;              // hook_props_file; all zero when it did not exist
+    io::Stamp vendor;            // /vendor/build.prop, which `real` is read from as well
+};
+static_assert(offsetof(Header, base) == 128, "Header layout must not depend on the ABI");
+static_assert(sizeof(Record) % 8 == 0 && sizeof(Slot) == 12 && sizeof(PropSlot) == 16,
+              "Record layout must not depend on the ABI");
+static_assert(sizeof(Header) % 8 == 0, "the pool must start at the same offset on every ABI");
+
+uint32_t fnv1a32(const void* data, size_t len, uint32_t hash = 2166136261u);
+uint64_t fnv1a64(const void* data, size_t len);
+
+// The prop table's hash: the length and the first, middle and last eight bytes of the
+// name, mixed. Never the whole name - a read the table does not have, nearly every read,
+// costs a strlen and three loads - and prop names differ where it looks: in their family,
+// their partition or their leaf. Names that collide only cost a compare.
+inline uint32_t propHash(const char* name, size_t len) {
+    uint64_t head = 0;
+    uint64_t middle = 0;
+    uint64_t tail = 0;
+    if (len >= 8) {
+        memcpy(&head, name, 8);
+        memcpy(&middle, name + (len - 8) / 2, 8);
+        memcpy(&tail, name + len - 8, 8);
+    } else {
+        memcpy(&head, name, len);
+    }
+    uint64_t x = (head ^ (middle * 0xC2B2AE3D27D4EB4Full) ^ (tail * 0x9E3779B97F4A7C15ull)) + len;
+    x ^= x >> 32;
+    x *= 0xBF58476D1CE4E5B9ull;
+    x ^= x >> 29;
+    return static_cast<uint32_t>(x);
+}
+
+// The header of `data` when it is a whole, intact image of this build's format; nullptr
+// otherwise. Says nothing about whether it is current.
+const Header* check(const void* data, size_t length);
+
+// Whether `config_path`, the policy, the ROM's build.props and the hook flag are still the
+// files `h` was built from.
+bool isCurrent(const Header& h, const char* config_path = config_file);
+
+// The record of `process` - see packages_object - or the default one, or the ROM's own when it
+// is excluded. For most processes one hash and one word of the Bloom filter; a probe or two for
+// the rest.
+const Record* recordOf(const Header& h, const char* process = nullptr);
+
+// recordOf(), resolved. Points into the image that `h` heads, which must outlive the view.
+ProfileView viewOf(const Header& h, const char* process = nullptr);
+
+// The prop table of `r`, slots then strings, in one run of `r.props.slots * sizeof(PropSlot)
+// + r.props.bytes` bytes; nullptr when it has none. Only its bounds are checked: see
+// prophook::install().
+const PropSlot* propsOf(const Header& h, const Record& r);
+
+// A mapped image that still describes its inputs. Unmapped on destruction.
+class Mapping {
+public:
+    // false means "fall back to the JSON": missing, another format version, torn, or stale
+    // against `config_path`.
+    bool open(const char* path, const char* config_path = config_file);
+    ProfileView view(const char* process = nullptr) const;
+    const Header* get() const { return header; }
+    size_t size() const { return header ? header->total_size : 0; }
+
+private:
+    io::MappedFile file;
+    const Header* header = nullptr;
+};
+
+// A prop and the value the config gives it.
+using Prop = std::pair<std::string, std::string>;
+// The props of each profile: "" for the default one, else a profiles_object name.
+using PropTables = std::map<std::string, std::vector<Prop>>;
+
+// Resolves the config exactly as the module would into an image in `out`, each record with
+// the table `props` has for its profile when given - a process whose profile is missing or
+// broken gets the default's, like its Build fields. Excluded processes get scanRomBuild()
+// and no props. Returns false, with the reason logged,
+// when the config cannot be read.
+bool build(const char* config_path, std::vector<char>& out, const PropTables* props = nullptr);
+
+// build(), then written to `image_path` atomically.
+bool compile(const char* config_path, const char* image_path, const PropTables* props = nullptr);
+
+} // namespace image
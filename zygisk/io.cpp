@@ -0,0 +1,117 @@
+#include "io.hpp"
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/xattr.h>
+#include <unistd.h>
+
+namespace io {
+
+Stamp stampOf(const struct stat& st) {
+    Stamp s{};
+    s.dev = st.st_dev;
+    s.ino = st.st_ino;
+    s.mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    s.size = st.st_size;
+    return s;
+}
+
+Stamp stampOf(const char* path) {
+    struct stat st;
+    if (stat(path, &st) != 0) return Stamp{};
+    return stampOf(st);
+}
+
+bool sameStamp(const Stamp& a, const Stamp& b) {
+    return a.dev == b.dev && a.ino == b.ino && a.mtime_ns == b.mtime_ns && a.size == b.size;
+}
+
+UniqueFd::~UniqueFd() {
+    if (fd >= 0) close(fd);
+}
+
+MappedFile::~MappedFile() {
+    reset();
+}
+
+void MappedFile::reset() {
+    if (addr) munmap(addr, length);
+    addr = nullptr;
+    length = 0;
+}
+
+bool MappedFile::open(const char* path, struct stat* st) {
+    reset();
+    UniqueFd fd(openRead(path));
+    struct stat local;
+    if (!fd || fstat(fd.get(), &local) != 0) return false;
+    if (st) *st = local;
+    if (local.st_size <= 0) return true;
+    void* mem = mmap(nullptr, static_cast<size_t>(local.st_size), PROT_READ, MAP_PRIVATE, fd.get(), 0);
+    if (mem == MAP_FAILED) return false;
+    addr = mem;
+    length = static_cast<size_t>(local.st_size);
+    return true;
+}
+
+int openRead(const char* path) {
+    int fd;
+    do {
+        fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    } while (fd < 0 && errno == EINTR);
+    return fd;
+}
+
+size_t readFull(int fd, void* buf, size_t len) {
+    auto out = static_cast<char*>(buf);
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = read(fd, out + done, len - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        done += static_cast<size_t>(n);
+    }
+    return done;
+}
+
+bool replaceFile(const char* path, const void* data, size_t len, const char* selinux_label) {
+    char tmp[PATH_MAX];
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= static_cast<int>(sizeof(tmp))) return false;
+    int fd = ::open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return false;
+    auto in = static_cast<const char*>(data);
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = write(fd, in + done, len - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        done += static_cast<size_t>(n);
+    }
+    const bool written = done == len && fsync(fd) == 0;
+    close(fd);
+    if (selinux_label) setxattr(tmp, "security.selinux", selinux_label, strlen(selinux_label) + 1, 0);
+    if (!written || rename(tmp, path) != 0) {
+        unlink(tmp);
+        return false;
+    }
+    return true;
+}
+
+const char* bootId() {
+    static char id[40];
+    static std::once_flag once;
+    std::call_once(once, [] {
+        UniqueFd fd(openRead("/proc/sys/kernel/random/boot_id"));
+        const size_t n = fd ? readFull(fd.get(), id, sizeof(id) - 1) : 0;
+        id[n] = '\0';
+        if (char* nl = strchr(id, '\n')) *nl = '\0';
+        if (!id[0]) strcpy(id, "-");
+    });
+    return id;
+}
+
+} // namespace io
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <sys/stat.h>
+
+// The little file I/O the module needs, straight on top of the syscalls. Nothing here
+// allocates, and every fd is opened O_CLOEXEC: zygote forks apps from this process.
+namespace io {
+
+// Identity of a file: what says "not the file it was" without reading it. All zero for a
+// file that does not exist, so one appearing later is a change as well. Fixed-width, no
+// padding: it is stored in files written by one ABI and read by another.
+struct Stamp {
+    uint64_t dev;
+    uint64_t ino;
+    int64_t mtime_ns;
+    int64_t size;
+};
+static_assert(sizeof(Stamp) == 32, "Stamp must not have padding");
+
+Stamp stampOf(const struct stat& st);
+Stamp stampOf(const char* path);
+bool sameStamp(const Stamp& a, const Stamp& b);
+
+// Owns one fd, closed on destruction.
+class UniqueFd {
+public:
+    explicit UniqueFd(int fd = -1) : fd(fd) {}
+    UniqueFd(const UniqueFd&) = delete;
+    UniqueFd& operator=(const UniqueFd&) = delete;
+    ~UniqueFd();
+
+    int get() const { return fd; }
+    explicit operator bool() const { return fd >= 0; }
+
+private:
+    int fd;
+};
+
+// A whole file mapped read-only and private. Unmapped on destruction.
+class MappedFile {
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    // false when the file cannot be opened or mapped. An empty file maps to nothing and
+    // still counts as open. `st`, when given, gets the fstat of the mapped file.
+    bool open(const char* path, struct stat* st = nullptr);
+    void reset();
+
+    const char* data() const { return static_cast<const char*>(addr); }
+    size_t size() const { return length; }
+
+private:
+    void* addr = nullptr;
+    size_t length = 0;
+};
+
+// open(path, O_RDONLY | O_CLOEXEC), retried on EINTR. -1 on failure, like open(2).
+int openRead(const char* path);
+
+// Reads until `len` bytes are in or the file ends; returns how many were read.
+size_t readFull(int fd, void* buf, size_t len);
+
+// Writes `len` bytes to path.tmp, fsyncs it and renames it over `path`, so a reader sees
+// the old file or the new one, never half of each. `selinux_label`, when given, is set on
+// the new file before it goes live; failing to set it is not an error.
+bool replaceFile(const char* path, const void* data, size_t len, const char* selinux_label = nullptr);
+
+// This boot's /proc/sys/kernel/random/boot_id, "-" when it cannot be read. Read once.
+const char* bootId();
+
+} // namespace io
@@ -0,0 +1,15 @@
+#pragma once
+
+#define LOG_TAG "COPG-VD"
+
+// The library logs to logcat. copgvd runs from the boot scripts and the WebUI, which only
+// ever see what it prints, so it logs to stderr instead - as does a host build, which has
+// no logcat to log to.
+#if defined(COPGVD_CLI) || !defined(__ANDROID__)
+#include <cstdio>
+#define LOGE(...) (std::fprintf(stderr, LOG_TAG ": " __VA_ARGS__), std::fputc('\n', stderr))
+#else
+#include <android/log.h>
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+#endif
+#define ERROR_LOG(...) LOGE("[ERROR] " __VA_ARGS__)
@@ -0,0 +1,385 @@
+#include "patch.hpp"
+#include "io.hpp"
+#include "log.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <sys/xattr.h>
+
+namespace patch {
+
+namespace {
+
+struct Member {
+    std::string_view key;       // as written, between the quotes
+    size_t key_start;           // its opening quote
+    size_t value_start;
+    size_t value_end;
+    size_t comma;               // the ',' after the value, or npos for the last member
+};
+
+struct Object {
+    size_t open = 0;            // '{'
+    std::vector<Member> members;
+};
+
+// Nesting deeper than this is not a config; it is a way to run the stack out.
+constexpr int kMaxDepth = 512;
+
+// Strict JSON, recognised and never built: all it keeps is where the members of the object
+// it is pointed at begin and end.
+class Scanner {
+public:
+    explicit Scanner(std::string_view text) : text(text) {}
+
+    // The object at `at`, with its members recorded. Nested values are only skipped.
+    bool scan(size_t at, Object& out, bool whole = false) {
+        pos = at;
+        if (whole) space();
+        if (!object(0, &out)) return false;
+        space();
+        return !whole || pos == text.size();
+    }
+
+private:
+    std::string_view text;
+    size_t pos = 0;
+
+    bool at(char c) const { return pos < text.size() && text[pos] == c; }
+
+    void space() {
+        while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\n' || text[pos] == '\r')) pos++;
+    }
+
+    bool string(std::string_view* raw = nullptr) {
+        if (!at('"')) return false;
+        const size_t start = ++pos;
+        while (pos < text.size()) {
+            const unsigned char c = static_cast<unsigned char>(text[pos]);
+            if (c == '"') {
+                if (raw) *raw = text.substr(start, pos - start);
+                pos++;
+                return true;
+            }
+            if (c < 0x20) return false;
+            if (c == '\\') {
+                if (++pos >= text.size()) return false;
+                const char e = text[pos];
+                if (e == 'u') {
+                    for (int i = 0; i < 4; i++) {
+                        if (++pos >= text.size() || !isxdigit(static_cast<unsigned char>(text[pos]))) return false;
+                    }
+                } else if (std::string_view("\"\\/bfnrt").find(e) == std::string_view::npos) {
+                    return false;
+                }
+            }
+            pos++;
+        }
+        return false;
+    }
+
+    bool digits() {
+        const size_t start = pos;
+        while (pos < text.size() && text[pos] >= '0' && text[pos] <= '9') pos++;
+        return pos > start;
+    }
+
+    bool number() {
+        if (at('-')) pos++;
+        if (at('0')) {
+            pos++;
+        } else if (!digits()) {
+            return false;
+        }
+        if (at('.')) {
+            pos++;
+            if (!digits()) return false;
+        }
+        if (at('e') || at('E')) {
+            pos++;
+            if (at('+') || at('-')) pos++;
+            if (!digits()) return false;
+        }
+        return true;
+    }
+
+    bool literal(std::string_view word) {
+        if (text.substr(pos, word.size()) != word) return false;
+        pos += word.size();
+        return true;
+    }
+
+    bool value(int depth) {
+        if (pos >= text.size()) return false;
+        switch (text[pos]) {
+            case '{': return object(depth + 1, nullptr);
+            case '[': return array(depth + 1);
+            case '"': return string();
+            case 't': return literal("true");
+            case 'f': return literal("false");
+            case 'n': return literal("null");
+            default: return number();
+        }
+    }
+
+    bool array(int depth) {
+        if (depth > kMaxDepth) return false;
+        pos++;
+        space();
+        if (at(']')) {
+            pos++;
+            return true;
+        }
+        for (;;) {
+            space();
+            if (!value(depth)) return false;
+            space();
+            if (at(']')) {
+                pos++;
+                return true;
+            }
+            if (!at(',')) return false;
+            pos++;
+        }
+    }
+
+    bool object(int depth, Object* out) {
+        if (depth > kMaxDepth || !at('{')) return false;
+        if (out) out->open = pos;
+        pos++;
+        space();
+        if (at('}')) {
+            pos++;
+            return true;
+        }
+        for (;;) {
+            space();
+            Member m;
+            m.key_start = pos;
+            if (!string(&m.key)) return false;
+            space();
+            if (!at(':')) return false;
+            pos++;
+            space();
+            m.value_start = pos;
+            if (!value(depth)) return false;
+            m.value_end = pos;
+            m.comma = std::string_view::npos;
+            space();
+            if (at(',')) m.comma = pos;
+            if (out) out->members.push_back(m);
+            if (at('}')) {
+                pos++;
+                return true;
+            }
+            if (!at(',')) return false;
+            pos++;
+        }
+    }
+};
+
+// Replaces text[from, to). An empty `with` over an empty range is never made.
+struct Splice {
+    size_t from;
+    size_t to;
+    std::string with;
+};
+
+std::string quoted(std::string_view value) {
+    std::string out = "\"";
+    for (char c : value) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char esc[8];
+            snprintf(esc, sizeof(esc), "\\u%04x", c);
+            out += esc;
+        } else {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
+
+template <typename List>
+auto lookup(const List& list, std::string_view key) -> decltype(&*list.begin()) {
+    for (const auto& item : list) {
+        if (item.first == key) return &item;
+    }
+    return nullptr;
+}
+
+bool dropped(const Edits& edits, std::string_view key) {
+    return std::find(edits.drop.begin(), edits.drop.end(), key) != edits.drop.end();
+}
+
+bool blank(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+// The start of the line `at` is on, when only blanks come before it there; npos otherwise.
+size_t lineStart(std::string_view text, size_t at) {
+    size_t s = at;
+    while (s > 0 && blank(text[s - 1])) s--;
+    return s == 0 || text[s - 1] == '\n' ? s : std::string_view::npos;
+}
+
+void edit(std::string_view text, const Object& obj, const Edits& edits, std::vector<Splice>& splices) {
+    std::vector<bool> seen(edits.set.size());
+    const Member* last_kept = nullptr;
+    bool kept = false;
+    for (const Member& m : obj.members) kept = kept || !dropped(edits, m.key);
+
+    for (const Member& m : obj.members) {
+        if (dropped(edits, m.key)) {
+            if (m.comma != std::string_view::npos) {
+                // A member on a line of its own takes the line with it.
+                const size_t line = lineStart(text, m.key_start);
+                size_t end = m.comma + 1;
+                while (end < text.size() && blank(text[end])) end++;
+                if (line != std::string_view::npos && end < text.size() && text[end] == '\n') {
+                    splices.push_back({line, end + 1, {}});
+                } else {
+                    splices.push_back({m.key_start, end, {}});
+                }
+            } else {
+                // The last member: the comma to drop is the one before it.
+                splices.push_back({last_kept ? last_kept->comma : obj.open + 1, m.value_end, {}});
+            }
+            continue;
+        }
+        last_kept = &m;
+        if (const auto* set = lookup(edits.set, m.key)) {
+            seen[static_cast<size_t>(set - edits.set.data())] = true;
+            splices.push_back({m.value_start, m.value_end, quoted(set->second)});
+        }
+    }
+
+    // What was missing goes first, laid out like the members already there: on lines of its
+    // own with their indent, or on their line with what they have after a comma. The key's
+    // separator, ": " or ":", is theirs as well.
+    std::string indent = "    ";
+    std::string colon = ": ";
+    bool own_lines = true;
+    std::string gap;
+    size_t at = obj.open + 1;
+    if (!obj.members.empty()) {
+        const Member& first = obj.members.front();
+        const size_t key_end = first.key_start + first.key.size() + 2;
+        colon = std::string(text.substr(key_end, first.value_start - key_end));
+        const size_t line = lineStart(text, first.key_start);
+        own_lines = line != std::string_view::npos;
+        if (own_lines) {
+            indent = std::string(text.substr(line, first.key_start - line));
+        } else {
+            gap = " ";
+            if (first.comma != std::string_view::npos) {
+                size_t next = first.comma + 1;
+                while (next < text.size() && (blank(text[next]) || text[next] == '\n')) next++;
+                gap = std::string(text.substr(first.comma + 1, next - first.comma - 1));
+            }
+            // Before the first key when something stays, so the brace keeps its spacing; when
+            // nothing does, after the brace, or the deletions would take the insertion along.
+            if (kept) {
+                at = first.key_start;
+                indent.clear();
+            } else {
+                indent = std::string(text.substr(obj.open + 1, first.key_start - obj.open - 1));
+            }
+        }
+    }
+    const std::string separator = own_lines ? "," : "," + gap;
+    std::string inserted;
+    for (size_t i = 0; i < edits.set.size(); i++) {
+        if (seen[i] || dropped(edits, edits.set[i].first)) continue;
+        if (!inserted.empty() && !kept) inserted += separator;
+        if (own_lines) {
+            inserted += "\n" + indent;
+        } else if (inserted.empty()) {
+            inserted += indent;
+        }
+        inserted += quoted(edits.set[i].first) + colon + quoted(edits.set[i].second);
+        if (kept) inserted += separator;
+    }
+    if (!inserted.empty()) splices.push_back({at, at, std::move(inserted)});
+}
+
+bool scan(std::string_view text, std::string_view object, Object& top, std::vector<Object>& targets) {
+    Scanner scanner(text);
+    if (!scanner.scan(0, top, true)) return false;
+    for (const Member& m : top.members) {
+        if (m.key != object || text[m.value_start] != '{') continue;
+        targets.emplace_back();
+        if (!scanner.scan(m.value_start, targets.back())) return false;
+    }
+    return !targets.empty();
+}
+
+} // namespace
+
+bool apply(std::string_view text, std::string_view object, const Edits& edits, std::string& out) {
+    Object top;
+    std::vector<Object> targets;
+    if (!scan(text, object, top, targets)) return false;
+
+    std::vector<Splice> splices;
+    for (const Member& m : top.members) {
+        if (const auto* set = lookup(edits.top, m.key)) splices.push_back({m.value_start, m.value_end, quoted(set->second)});
+    }
+    for (const Object& obj : targets) edit(text, obj, edits, splices);
+
+    // In order; an insertion goes before a deletion starting at the same place, and whatever
+    // falls inside a deleted range goes with it.
+    std::sort(splices.begin(), splices.end(), [](const Splice& a, const Splice& b) {
+        return a.from != b.from ? a.from < b.from : a.to < b.to;
+    });
+    std::string result;
+    result.reserve(text.size() + 256);
+    size_t pos = 0;
+    for (const Splice& s : splices) {
+        if (s.from < pos) {
+            if (s.with.empty()) pos = std::max(pos, s.to);
+            continue;
+        }
+        result.append(text.substr(pos, s.from - pos));
+        result += s.with;
+        pos = s.to;
+    }
+    result.append(text.substr(pos));
+
+    // Never hand back something that would not read again.
+    Object check_top;
+    std::vector<Object> check;
+    if (!scan(result, object, check_top, check)) return false;
+    out = std::move(result);
+    return true;
+}
+
+bool file(const char* path, std::string_view object, const Edits& edits) {
+    io::MappedFile in;
+    if (!in.open(path)) {
+        ERROR_LOG("Failed to open: %s", path);
+        return false;
+    }
+    const std::string_view text(in.data(), in.size());
+    std::string out;
+    if (!apply(text, object, edits, out)) {
+        ERROR_LOG("Not a JSON object with a \"%.*s\" object in it, left untouched: %s",
+                  static_cast<int>(object.size()), object.data(), path);
+        return false;
+    }
+    if (out == text) return true;
+
+    // zygote reads the config: the new file must be labelled like the one it replaces.
+    char label[256];
+    const ssize_t n = getxattr(path, "security.selinux", label, sizeof(label) - 1);
+    if (n > 0) label[n] = '\0';
+    if (!io::replaceFile(path, out.data(), out.size(), n > 0 ? label : nullptr)) {
+        ERROR_LOG("Failed to write: %s", path);
+        return false;
+    }
+    return true;
+}
+
+} // namespace patch
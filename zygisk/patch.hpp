@@ -0,0 +1,33 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Edits a config the way a person would: the values of a few keys change and every other
+// byte - indentation, key order, repeated keys, the other objects - stays where it was.
+// The file is read once and tokenised once; each edit is a splice over the byte span of a
+// value or a member, so the cost is linear in the file and braces inside strings are just
+// string bytes.
+namespace patch {
+
+struct Edits {
+    // Keys of every top-level `object`, their value replaced by this string; inserted first
+    // in the object when it does not have them.
+    std::vector<std::pair<std::string, std::string>> set;
+    // Keys removed from every top-level `object`, repeats included.
+    std::vector<std::string> drop;
+    // Top-level keys whose value is replaced where they exist. Never inserted.
+    std::vector<std::pair<std::string, std::string>> top;
+};
+
+// `text` with the edits applied. false, with `out` untouched, when `text` is not a JSON object
+// or has no `object` in it. Keys are compared as written, escapes and all.
+bool apply(std::string_view text, std::string_view object, const Edits& edits, std::string& out);
+
+// apply() on the file at `path`, which is replaced atomically - keeping its SELinux label -
+// and only when something changed. The reason is logged when it returns false.
+bool file(const char* path, std::string_view object, const Edits& edits);
+
+} // namespace patch
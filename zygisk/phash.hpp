@@ -0,0 +1,123 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// A perfect hash over a fixed set of strings, built by the compiler: finding a string's index,
+// or learning it is not in the set, is one hash, two table reads and one compare.
+//
+// Hash and displace. Every string falls in a bucket; the buckets are placed biggest first,
+// each with the first seed that sends all of its strings to slots still free. Empty strings
+// are never in the set, and a string listed twice is found at its first index.
+namespace phash {
+
+constexpr uint64_t hash(std::string_view s) {
+    uint64_t h = 14695981039346656037ull;
+    for (char c : s) h = (h ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+    return h;
+}
+
+constexpr size_t slotOf(uint64_t h, uint32_t seed, size_t mask) {
+    uint64_t x = h ^ (seed * 0x9E3779B97F4A7C15ull);
+    x ^= x >> 31;
+    x *= 0xBF58476D1CE4E5B9ull;
+    x ^= x >> 29;
+    return static_cast<size_t>(x) & mask;
+}
+
+constexpr size_t pow2AtLeast(size_t n) {
+    size_t p = 1;
+    while (p < n) p <<= 1;
+    return p;
+}
+
+// Deliberately never defined: a set the table cannot place stops the build.
+uint32_t unplaceable();
+
+template <size_t N>
+class Table {
+public:
+    static constexpr size_t kBuckets = N / 2 + 1;
+    static constexpr size_t kSlots = pow2AtLeast(2 * N);
+    static constexpr uint16_t kEmpty = 0xFFFF;
+    static constexpr size_t kMaxBucket = 16;
+    static_assert(N < kEmpty, "indices are 16 bits");
+
+    // `keys` must outlive the table: make both static constexpr.
+    explicit constexpr Table(const std::array<std::string_view, N>& keys) : keys(keys.data()) {
+        uint64_t h[N] = {};
+        size_t count[kBuckets] = {};
+        for (size_t i = 0; i < N; i++) {
+            if (keys[i].empty()) continue;
+            h[i] = hash(keys[i]);
+            count[bucketOf(h[i])]++;
+        }
+        // Members of each bucket, contiguous: bucket b is member[start[b] .. start[b + 1]).
+        size_t start[kBuckets + 1] = {};
+        size_t largest = 0;
+        for (size_t b = 0; b < kBuckets; b++) {
+            start[b + 1] = start[b] + count[b];
+            if (count[b] > largest) largest = count[b];
+        }
+        size_t member[N] = {};
+        size_t filled[kBuckets] = {};
+        for (size_t i = 0; i < N; i++) {
+            if (keys[i].empty()) continue;
+            const size_t b = bucketOf(h[i]);
+            member[start[b] + filled[b]++] = i;
+        }
+        for (size_t s = 0; s < kSlots; s++) slot[s] = kEmpty;
+
+        for (size_t size = largest; size > 0; size--) {
+            for (size_t b = 0; b < kBuckets; b++) {
+                if (count[b] != size) continue;
+                // Repeats share a hash, so they share a bucket: drop all but the first here.
+                size_t unique[kMaxBucket] = {};
+                size_t n = 0;
+                for (size_t m = start[b]; m < start[b + 1]; m++) {
+                    bool repeat = false;
+                    for (size_t u = 0; u < n; u++) repeat = repeat || keys[unique[u]] == keys[member[m]];
+                    if (repeat) continue;
+                    if (n == kMaxBucket) seed[b] = unplaceable();
+                    unique[n++] = member[m];
+                }
+                seed[b] = place(h, unique, n);
+            }
+        }
+    }
+
+    // The index of `s` in the set; N when it is not in it.
+    constexpr size_t find(std::string_view s) const {
+        const uint64_t h = hash(s);
+        const uint16_t i = slot[slotOf(h, seed[bucketOf(h)], kSlots - 1)];
+        return i != kEmpty && keys[i] == s ? i : N;
+    }
+
+private:
+    const std::string_view* keys;
+    uint32_t seed[kBuckets] = {};
+    uint16_t slot[kSlots] = {};
+
+    static constexpr size_t bucketOf(uint64_t h) { return static_cast<size_t>(h >> 40) % kBuckets; }
+
+    // The first seed that puts every string of a bucket in a free slot of its own.
+    constexpr uint32_t place(const uint64_t (&h)[N], const size_t (&unique)[kMaxBucket], size_t n) {
+        for (uint32_t s = 0; s < (1u << 16); s++) {
+            size_t pos[kMaxBucket] = {};
+            bool fits = true;
+            for (size_t k = 0; fits && k < n; k++) {
+                pos[k] = slotOf(h[unique[k]], s, kSlots - 1);
+                fits = slot[pos[k]] == kEmpty;
+                for (size_t j = 0; fits && j < k; j++) fits = pos[j] != pos[k];
+            }
+            if (!fits) continue;
+            for (size_t k = 0; k < n; k++) slot[pos[k]] = static_cast<uint16_t>(unique[k]);
+            return s;
+        }
+        return unplaceable();
+    }
+};
+
+} // namespace phash
@@ -0,0 +1,1124 @@
+#include "profile.hpp"
+#include "io.hpp"
+#include "log.hpp"
+#include "phash.hpp"
+#include "stats.hpp"
+#include "trace.hpp"
+#include <json.hpp>
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+#include <optional>
+#include <cctype>
+#include <sys/stat.h>
+
+using json = nlohmann::json;
+
+std::string_view trim(std::string_view str) {
+    auto space = [](unsigned char c) { return std::isspace(c) != 0; };
+    while (!str.empty() && space(str.front())) str.remove_prefix(1);
+    while (!str.empty() && space(str.back())) str.remove_suffix(1);
+    return str;
+}
+
+// What std::stoi accepts, without the exceptions: leading blanks and a '+' are skipped and
+// anything may follow the digits. false when there is no number, or it does not fit.
+template <typename T>
+static bool parseNumber(std::string_view text, T& out) {
+    while (!text.empty() && std::isspace(static_cast<unsigned char>(text.front()))) text.remove_prefix(1);
+    if (!text.empty() && text.front() == '+') {
+        text.remove_prefix(1);
+        if (!text.empty() && text.front() == '-') return false;
+    }
+    const char* const end = text.data() + text.size();
+    const auto [last, ec] = std::from_chars(text.data(), end, out);
+    return ec == std::errc() && last != text.data();
+}
+
+char* Arena::reset(size_t capacity, size_t scratch) {
+    buf.reset(new char[capacity + scratch]);
+    cap = capacity;
+    used = 0;
+    return buf.get() + capacity;
+}
+
+std::string_view Arena::keep(std::string_view s) {
+    if (s.size() >= cap - used) return {};
+    char* out = buf.get() + used;
+    memcpy(out, s.data(), s.size());
+    out[s.size()] = '\0';
+    used += s.size() + 1;
+    return std::string_view(out, s.size());
+}
+
+// The three keys sit together near the top of a generated build.prop, each once. So instead
+// of walking every line, the scan jumps from one occurrence of the shared prefix to the next
+// with memmem - libc's, already vectorized - and stops as soon as it has all three.
+RomVersion scanRomVersion(const char* path) {
+    RomVersion rom;
+    io::MappedFile file;
+    if (!file.open(path)) return rom;      // unknown ROM -> nothing is allowed through
+    static constexpr std::string_view prefix = "ro.build.version.";
+    const char* const begin = file.data();
+    const char* const end = begin + file.size();
+    bool release = false, codename = false, sdk = false;
+    for (const char* p = begin; p < end && !(release && codename && sdk);) {
+        auto hit = static_cast<const char*>(memmem(p, end - p, prefix.data(), prefix.size()));
+        if (!hit) break;
+        auto eol = static_cast<const char*>(memchr(hit, '\n', end - hit));
+        if (!eol) eol = end;
+        p = eol;
+        if (hit != begin && hit[-1] != '\n') continue;      // not a key: a comment, or a value
+
+        const std::string_view rest(hit + prefix.size(), eol - hit - prefix.size());
+        auto take = [&rest](std::string_view key, std::string& out) {
+            if (rest.size() <= key.size() || rest.compare(0, key.size(), key) != 0 || rest[key.size()] != '=') {
+                return false;
+            }
+            out = std::string(trim(rest.substr(key.size() + 1)));
+            return true;
+        };
+        std::string value;
+        if (!release && take("release", rom.release)) {
+            release = true;
+        } else if (!codename && take("codename", rom.codename)) {
+            codename = true;
+        } else if (!sdk && take("sdk", value)) {
+            sdk = true;
+            if (!parseNumber(value, rom.sdk)) rom.sdk = 0;
+        }
+    }
+    return rom;
+}
+
+namespace {
+
+// The ROM only changes with an OTA, and an OTA replaces build.prop: same stamp, same version.
+// Both zygotes, and every zygote restart, get away with a stat and one small read.
+struct RomCache {
+    uint32_t magic;
+    int32_t sdk;
+    io::Stamp prop;
+    char release[92];
+    char codename[92];
+};
+static_assert(sizeof(RomCache) == 224, "RomCache layout must not depend on the ABI");
+constexpr uint32_t kRomCacheMagic = 0x31524743;     // "CGR1"
+
+#ifdef COPGVD_CLI
+template <size_t N>
+bool fill(char (&out)[N], const std::string& value) {
+    if (value.size() >= sizeof(out)) return false;
+    memcpy(out, value.data(), value.size());
+    return true;
+}
+#endif
+
+} // namespace
+
+RomVersion readRomVersion() {
+    // Stamped before the scan: a build.prop replaced halfway through leaves a stale stamp.
+    const io::Stamp prop = io::stampOf(rom_prop_file);
+    RomCache cache{};
+    io::UniqueFd fd(io::openRead(rom_cache_file));
+    if (fd && io::readFull(fd.get(), &cache, sizeof(cache)) == sizeof(cache) &&
+        cache.magic == kRomCacheMagic && prop.size != 0 && io::sameStamp(cache.prop, prop) &&
+        memchr(cache.release, '\0', sizeof(cache.release)) && memchr(cache.codename, '\0', sizeof(cache.codename))) {
+        RomVersion rom;
+        rom.release = cache.release;
+        rom.codename = cache.codename;
+        rom.sdk = cache.sdk;
+        return rom;
+    }
+
+    const RomVersion rom = scanRomVersion(rom_prop_file);
+#ifdef COPGVD_CLI
+    // Only the root side writes it. Zygote may not write under /data/adb, and the boot
+    // scripts run copgvd before it starts anyway.
+    cache = RomCache{};
+    cache.magic = kRomCacheMagic;
+    cache.sdk = rom.sdk;
+    cache.prop = prop;
+    if (prop.size != 0 && fill(cache.release, rom.release) && fill(cache.codename, rom.codename)) {
+        io::replaceFile(rom_cache_file, &cache, sizeof(cache));
+    }
+#endif
+    return rom;
+}
+
+// The value of `key` in a build.prop, first copy, trimmed; empty when it is not there.
+static std::string propValue(const io::MappedFile& file, std::string_view key) {
+    const char* const begin = file.data();
+    const char* const end = begin + file.size();
+    for (const char* p = begin; p < end;) {
+        auto hit = static_cast<const char*>(memmem(p, end - p, key.data(), key.size()));
+        if (!hit) break;
+        p = hit + key.size();
+        if ((hit == begin || hit[-1] == '\n') && p < end && *p == '=') {
+            auto eol = static_cast<const char*>(memchr(p, '\n', end - p));
+            return std::string(trim(std::string_view(p + 1, (eol ? eol : end) - p - 1)));
+        }
+    }
+    return {};
+}
+
+// An androidboot.* value as the bootloader passed it: /proc/bootconfig since Android 12, the
+// kernel command line before that.
+static std::string bootValue(std::string_view key) {
+    char buf[16384];
+    for (const char* path : {bootconfig_file, cmdline_file}) {
+        io::UniqueFd fd(io::openRead(path));
+        if (!fd) continue;
+        const std::string_view text(buf, io::readFull(fd.get(), buf, sizeof(buf)));
+        // bootconfig: one `key = "value"` a line. cmdline: `key=value`, blank-separated.
+        for (size_t at = text.find(key); at != std::string_view::npos; at = text.find(key, at + 1)) {
+            if (at > 0 && text[at - 1] != '\n' && text[at - 1] != ' ') continue;
+            std::string_view rest = text.substr(at + key.size());
+            const size_t lead = rest.find_first_not_of(' ');
+            if (lead == std::string_view::npos || rest[lead] != '=') continue;
+            rest = trim(rest.substr(lead + 1));
+            if (!rest.empty() && rest.front() == '"') {
+                rest.remove_prefix(1);
+                return std::string(rest.substr(0, rest.find('"')));
+            }
+            return std::string(rest.substr(0, rest.find_first_of(" \n")));
+        }
+    }
+    return {};
+}
+
+static Hardware scanHardware() {
+    Hardware hw;
+    io::MappedFile vendor;
+    const bool mapped = vendor.open(vendor_prop_file);
+    if (mapped) hw[HwKey::Device] = propValue(vendor, "ro.product.vendor.device");
+    hw[HwKey::Hardware] = bootValue("androidboot.hardware");
+    if (mapped && hw[HwKey::Hardware].empty()) hw[HwKey::Hardware] = propValue(vendor, "ro.hardware");
+    if (mapped) hw[HwKey::Board] = propValue(vendor, "ro.product.board");
+    if (mapped && hw[HwKey::Board].empty()) hw[HwKey::Board] = propValue(vendor, "ro.board.platform");
+    return hw;
+}
+
+namespace {
+
+// Like RomCache. The bootloader's part only changes with a new vendor image in practice, so
+// the vendor build.prop's stamp stands for both.
+struct HwCache {
+    uint32_t magic;
+    uint32_t reserved;
+    io::Stamp prop;
+    char value[static_cast<size_t>(HwKey::Count)][96];
+};
+static_assert(sizeof(HwCache) == 328, "HwCache layout must not depend on the ABI");
+constexpr uint32_t kHwCacheMagic = 0x31574843;      // "CHW1"
+
+} // namespace
+
+const char* hwKeyName(HwKey key) {
+    switch (key) {
+        case HwKey::Device: return "device";
+        case HwKey::Hardware: return "hardware";
+        case HwKey::Board: return "board";
+        case HwKey::Count: break;
+    }
+    return "";
+}
+
+Hardware readHardware() {
+    const io::Stamp prop = io::stampOf(vendor_prop_file);
+    HwCache cache{};
+    io::UniqueFd fd(io::openRead(hw_cache_file));
+    if (fd && io::readFull(fd.get(), &cache, sizeof(cache)) == sizeof(cache) && cache.magic == kHwCacheMagic &&
+        prop.size != 0 && io::sameStamp(cache.prop, prop)) {
+        Hardware hw;
+        bool ok = true;
+        for (size_t k = 0; k < static_cast<size_t>(HwKey::Count); k++) {
+            ok = ok && memchr(cache.value[k], '\0', sizeof(cache.value[k]));
+            if (ok) hw.value[k] = cache.value[k];
+        }
+        if (ok) return hw;
+    }
+
+    const Hardware hw = scanHardware();
+#ifdef COPGVD_CLI
+    // zygote may not be allowed /proc/cmdline, let alone to write here.
+    cache = HwCache{};
+    cache.magic = kHwCacheMagic;
+    cache.prop = prop;
+    bool ok = prop.size != 0;
+    for (size_t k = 0; k < static_cast<size_t>(HwKey::Count); k++) ok = ok && fill(cache.value[k], hw.value[k]);
+    if (ok) io::replaceFile(hw_cache_file, &cache, sizeof(cache));
+#endif
+    return hw;
+}
+
+VersionPolicy readVersionPolicy() {
+    io::UniqueFd fd(io::openRead(version_policy_file));
+    if (!fd) return VersionPolicy::Never;
+    // One short word on the first line; anything longer is not a policy anyway.
+    char buf[64];
+    std::string_view line(buf, io::readFull(fd.get(), buf, sizeof(buf)));
+    line = trim(line.substr(0, line.find('\n')));
+    if (line == "force") return VersionPolicy::Force;
+    if (line == "rom") return VersionPolicy::Rom;
+    return VersionPolicy::Never;
+}
+
+// AOSP: RELEASE_OR_CODENAME = "REL".equals(CODENAME) ? RELEASE : CODENAME. Copying CODENAME
+// into it publishes the literal string "REL" where the version number belongs, which is a
+// combination no real device reports.
+static std::string_view releaseOrCodename(std::string_view codename, std::string_view release) {
+    return (codename.empty() || codename == "REL") ? release : codename;
+}
+
+namespace {
+
+// The slots loadProfile() fills in itself rather than copying a JSON key.
+constexpr size_t kProduct = fieldOf("PRODUCT");
+constexpr size_t kHardware = fieldOf("HARDWARE");
+constexpr size_t kOdmSku = fieldOf("ODM_SKU");
+constexpr size_t kSku = fieldOf("SKU");
+constexpr size_t kTags = fieldOf("TAGS");
+constexpr size_t kType = fieldOf("TYPE");
+constexpr size_t kTime = fieldOf("TIME");
+constexpr size_t kCodename = fieldOf("CODENAME");
+constexpr size_t kRelease = fieldOf("RELEASE");
+constexpr size_t kSdk = fieldOf("SDK");
+constexpr size_t kSdkInt = fieldOf("SDK_INT");
+constexpr size_t kSdkIntFull = fieldOf("SDK_INT_FULL");
+constexpr size_t kReleaseOrCodename = fieldOf("RELEASE_OR_CODENAME");
+constexpr size_t kReleaseOrPreviewDisplay = fieldOf("RELEASE_OR_PREVIEW_DISPLAY");
+
+// Keys that feed no field as they are: the version group and TIMESTAMP arrive as text and
+// only become DeviceInfo after the policy has had its say. They are numbered after the
+// kBuildFields rows, so one index covers every key the reader recognises.
+enum RawKey : size_t {
+    R_TIMESTAMP = kFieldCount, R_CODENAME, R_ANDROID_VERSION, R_SDK_INT, R_SDK_FULL, R_END
+};
+constexpr const char* kRawKeys[] = {"TIMESTAMP", "CODENAME", "ANDROID_VERSION", "SDK_INT", "SDK_FULL"};
+static_assert(std::size(kRawKeys) == R_END - kFieldCount, "one name per RawKey");
+static_assert(R_END <= 64, "the reader keeps one bit per key");
+
+struct RawKeys {
+    std::string_view value[R_END - kFieldCount];
+    std::string_view& operator[](size_t key) { return value[key - kFieldCount]; }
+};
+
+const char* keyName(size_t key) {
+    return key < kFieldCount ? kBuildFields[key].key : kRawKeys[key - kFieldCount];
+}
+
+// Every key the reader recognises, by index; rows the module derives have none.
+constexpr std::array<std::string_view, R_END> keyNames() {
+    std::array<std::string_view, R_END> names{};
+    for (size_t k = 0; k < R_END; k++) {
+        const char* name = k < kFieldCount ? kBuildFields[k].key : kRawKeys[k - kFieldCount];
+        if (name) names[k] = name;
+    }
+    return names;
+}
+constexpr std::array<std::string_view, R_END> kKeyNames = keyNames();
+constexpr phash::Table<R_END> kKeyIndex(kKeyNames);
+
+// Materializes one profile - "COPG-VD", or the entry of profiles_object named `target` - and
+// nothing else. Every other part of the document - the instructions, the other profiles, the
+// settings - goes past the parser without being built, and each recognised key is copied
+// straight into the arena and viewed from its DeviceInfo slot.
+//
+// Same outcome as the DOM it replaces: the last copy of the profile wins, so does the last
+// copy of a key, and a recognised key left holding anything but a string is a config error.
+class ProfileReader {
+public:
+    ProfileReader(DeviceInfo& info, RawKeys& raw, std::string_view target)
+        : info(info), raw(raw), target(target), profile_depth(target.empty() ? 2 : 3) {
+        restart();
+    }
+
+    std::string error;
+
+    bool has(size_t key) const { return seen & (uint64_t{1} << key); }
+
+    // Whether the profile was there at all. "COPG-VD" missing only means nothing to spoof.
+    bool found() const { return present; }
+
+    // For a document that is the profile's value alone.
+    void bare() {
+        depth = profile_depth - 1;
+        profile_next = true;
+    }
+
+    // A wrong type only counts if nothing later replaced it, as it would in the DOM.
+    bool mistyped() {
+        for (size_t k = 0; k < R_END; k++) {
+            if (bad & (uint64_t{1} << k)) {
+                error = std::string(keyName(k)) + " must be a string";
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool null() { return scalar(); }
+    bool boolean(bool) { return scalar(); }
+    bool number_integer(json::number_integer_t) { return scalar(); }
+    bool number_unsigned(json::number_unsigned_t) { return scalar(); }
+    bool number_float(json::number_float_t, const std::string&) { return scalar(); }
+    bool binary(json::binary_t&) { return scalar(); }
+
+    bool string(std::string& val) {
+        if (slot != kNone) {
+            std::string_view& out = slot < kFieldCount ? info.str[slot] : raw[slot];
+            out = info.arena.keep(val);
+            if (!out.data()) {
+                error = std::string(keyName(slot)) + ": no room left for the value";
+                return false;
+            }
+            seen |= uint64_t{1} << slot;
+            bad &= ~(uint64_t{1} << slot);
+            slot = kNone;
+            return true;
+        }
+        return scalar();
+    }
+
+    bool start_object(std::size_t) {
+        if (slot != kNone) mismatch();
+        if (library_next) {
+            library_next = false;
+            restart();
+            present = false;
+            in_library = true;
+        }
+        if (profile_next) {
+            profile_next = false;
+            restart();
+            present = true;
+            in_profile = true;
+        }
+        depth++;
+        return true;
+    }
+
+    bool end_object() {
+        if (--depth == profile_depth - 1) in_profile = false;
+        if (depth == 1) in_library = false;
+        return true;
+    }
+
+    bool start_array(std::size_t) {
+        if (slot != kNone) mismatch();
+        next();
+        depth++;
+        return true;
+    }
+
+    bool end_array() {
+        depth--;
+        return true;
+    }
+
+    bool key(std::string& val) {
+        if (depth == 1) {
+            profile_next = target.empty() && val == LOG_TAG;
+            library_next = !target.empty() && val == profiles_object;
+        } else if (in_library && depth == 2) {
+            profile_next = val == target;
+        } else if (in_profile && depth == profile_depth) {
+            const size_t k = kKeyIndex.find(val);
+            if (k != R_END) slot = k;
+        }
+        return true;
+    }
+
+    bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception& ex) {
+        error = ex.what();
+        return false;
+    }
+
+private:
+    static constexpr size_t kNone = R_END;
+
+    DeviceInfo& info;
+    RawKeys& raw;
+    const std::string_view target;
+    const int profile_depth;        // where the profile's own keys are
+    size_t slot = kNone;            // the key whose value comes next
+    uint64_t seen = 0;              // keys present, by index
+    uint64_t bad = 0;               // keys whose latest value is not a string
+    int depth = 0;
+    bool profile_next = false;      // the last key named the profile
+    bool library_next = false;      // the last top-level key was profiles_object
+    bool in_profile = false;
+    bool in_library = false;
+    bool present = false;
+
+    // A later copy of the profile - or of the library it is in - replaces an earlier one,
+    // whatever it holds.
+    void restart() {
+        // The arena keeps the strings it already holds: it is sized for every value in the
+        // document, not just the ones that survive.
+        std::fill(std::begin(info.str), std::end(info.str), std::string_view());
+        std::fill(std::begin(info.num), std::end(info.num), 0);
+        raw = RawKeys{};
+        seen = 0;
+        bad = 0;
+    }
+
+    // The value of a key the reader was waiting on is not an object.
+    void next() {
+        if (profile_next || library_next) {
+            restart();
+            present = false;
+        }
+        profile_next = library_next = false;
+    }
+
+    bool scalar() {
+        if (slot != kNone) return mismatch();
+        next();
+        return true;
+    }
+
+    bool mismatch() {
+        bad |= uint64_t{1} << slot;
+        slot = kNone;
+        return true;
+    }
+};
+
+// The string members of the last packages_object, the strings of the last exclude_list, the
+// last active_key and the rules of the last match_object, and nothing else.
+class RoutingReader {
+public:
+    explicit RoutingReader(Routing& out) : out(out) {}
+
+    // For a document that is the value of top-level `name` alone.
+    void bare(std::string name) {
+        depth = 1;
+        key(name);
+    }
+
+    bool null() { return scalar(); }
+    bool boolean(bool) { return scalar(); }
+    bool number_integer(json::number_integer_t) { return scalar(); }
+    bool number_unsigned(json::number_unsigned_t) { return scalar(); }
+    bool number_float(json::number_float_t, const std::string&) { return scalar(); }
+    bool binary(json::binary_t&) { return scalar(); }
+
+    bool string(std::string& val) {
+        if (pending) {
+            out.profiles.emplace_back(std::move(name), std::move(val));
+            pending = false;
+            return true;
+        }
+        if (in_list && depth == 2) {
+            out.excluded.push_back(std::move(val));
+            return true;
+        }
+        if (active_next) {
+            out.active = std::move(val);
+            active_next = false;
+            return true;
+        }
+        if (rule_pending) {
+            out.rules.push_back({rule_key, std::move(name), std::move(val)});
+            rule_pending = false;
+            return true;
+        }
+        return scalar();
+    }
+
+    bool start_object(std::size_t) {
+        if (map_next) in_map = true;
+        if (match_next) in_match = true;
+        if (rules_next) in_rules = true;
+        scalar();
+        depth++;
+        return true;
+    }
+
+    bool end_object() {
+        if (--depth == 2) in_rules = false;
+        if (depth == 1) in_map = in_match = false;
+        return true;
+    }
+
+    bool start_array(std::size_t) {
+        if (list_next) in_list = true;
+        scalar();
+        depth++;
+        return true;
+    }
+
+    bool end_array() {
+        if (--depth == 1) in_list = false;
+        return true;
+    }
+
+    bool key(std::string& val) {
+        if (depth == 1) {
+            map_next = val == packages_object;
+            list_next = val == exclude_list;
+            active_next = val == active_key;
+            match_next = val == match_object;
+        } else if (in_map && depth == 2) {
+            name = std::move(val);
+            pending = true;
+        } else if (in_match && depth == 2) {
+            rule_key = HwKey::Count;
+            for (size_t k = 0; k < static_cast<size_t>(HwKey::Count); k++) {
+                if (val == hwKeyName(static_cast<HwKey>(k))) rule_key = static_cast<HwKey>(k);
+            }
+            rules_next = rule_key != HwKey::Count;
+        } else if (in_rules && depth == 3) {
+            name = std::move(val);
+            rule_pending = true;
+        }
+        return true;
+    }
+
+    bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception&) { return false; }
+
+private:
+    Routing& out;
+    std::string name;
+    int depth = 0;
+    bool map_next = false;
+    bool list_next = false;
+    bool active_next = false;
+    bool match_next = false;
+    bool rules_next = false;        // the last key of match_object was one of HwKey's
+    bool in_map = false;
+    bool in_list = false;
+    bool in_match = false;
+    bool in_rules = false;
+    bool pending = false;
+    bool rule_pending = false;
+    HwKey rule_key = HwKey::Count;
+
+    // A later packages_object, exclude_list, active_key, match_object - or key of it - replaces
+    // an earlier one, whatever it holds.
+    bool scalar() {
+        if (map_next) out.profiles.clear();
+        if (list_next) out.excluded.clear();
+        if (active_next) out.active.clear();
+        if (match_next) out.rules.clear();
+        if (rules_next) {
+            const HwKey key = rule_key;
+            out.rules.erase(std::remove_if(out.rules.begin(), out.rules.end(),
+                                           [key](const MatchRule& r) { return r.key == key; }),
+                            out.rules.end());
+        }
+        map_next = list_next = active_next = match_next = rules_next = pending = rule_pending = false;
+        return true;
+    }
+};
+
+// What `process` gets, by its own entry, else by its package's: excluded, a profile's name,
+// or empty for "COPG-VD".
+struct Pick {
+    bool excluded = false;
+    std::string_view profile;
+};
+
+Pick pickFor(const Routing& map, std::string_view process) {
+    const std::string_view package = process.substr(0, process.find(':'));
+    for (const std::string_view name : {process, package}) {
+        Pick pick;
+        for (const std::string& e : map.excluded) pick.excluded = pick.excluded || e == name;
+        for (const auto& [mapped, profile] : map.profiles) {
+            if (mapped == name) pick.profile = profile;
+        }
+        if (pick.excluded || !pick.profile.empty()) return pick;
+    }
+    return {};
+}
+
+// Nesting deeper than this is not a config; it is a way to run the stack out.
+constexpr int kMaxDepth = 512;
+
+const char* space(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) p++;
+    return p;
+}
+
+// Past the string whose opening quote is at `p`; nullptr when it never closes.
+const char* skipString(const char* p, const char* end) {
+    for (p++; (p = static_cast<const char*>(memchr(p, '"', end - p))); p++) {
+        // The opening quote stops this: it is not a backslash.
+        size_t slashes = 0;
+        while (p[-1 - static_cast<ptrdiff_t>(slashes)] == '\\') slashes++;
+        if (slashes % 2 == 0) return p + 1;
+    }
+    return nullptr;
+}
+
+constexpr std::array<bool, 256> structural() {
+    std::array<bool, 256> table{};
+    for (unsigned char c : {'"', '{', '}', '[', ']'}) table[c] = true;
+    return table;
+}
+constexpr std::array<bool, 256> kStructural = structural();
+
+// Past the value at `p`. Strings are stepped over and brackets paired; a scalar is just
+// the bytes up to the next delimiter. nullptr when the structure is broken.
+const char* skipValue(const char* p, const char* end) {
+    if (p == end) return nullptr;
+    if (*p == '"') return skipString(p, end);
+    if (*p != '{' && *p != '[') {
+        const char* start = p;
+        while (p < end && !strchr(",}] \t\r\n", *p)) p++;
+        return p != start ? p : nullptr;
+    }
+    char closers[kMaxDepth];
+    int depth = 0;
+    while (p < end) {
+        // Between strings a value is mostly blanks, digits and separators, none of them
+        // interesting; inside strings memchr does the walking.
+        while (p < end && !kStructural[static_cast<unsigned char>(*p)]) p++;
+        if (p == end) break;
+        const char c = *p;
+        if (c == '"') {
+            if (!(p = skipString(p, end))) return nullptr;
+            continue;
+        }
+        if (c == '{' || c == '[') {
+            if (depth == kMaxDepth) return nullptr;
+            closers[depth++] = c == '{' ? '}' : ']';
+        } else if (c == '}' || c == ']') {
+            if (depth == 0 || closers[--depth] != c) return nullptr;
+            if (depth == 0) return p + 1;
+        }
+        p++;
+    }
+    return nullptr;
+}
+
+// Where the members of one object are, found by a byte scan that builds nothing. It is no
+// validator - a scalar is stepped over, not read - so it only fails on a broken structure,
+// and then the full parse says why.
+class Outline {
+public:
+    // The object that is the whole of `text`, blanks aside.
+    bool open(std::string_view text) {
+        members.clear();
+        const char* end = text.data() + text.size();
+        const char* p = space(text.data(), end);
+        if (p == end || *p != '{') return false;
+        p = space(p + 1, end);
+        if (p < end && *p == '}') return space(p + 1, end) == end;
+        for (;;) {
+            if (p == end || *p != '"') return false;
+            const char* key = p + 1;
+            if (!(p = skipString(p, end))) return false;
+            const std::string_view name(key, p - 1 - key);
+            // An escaped key would need unescaping to compare; the parser does that.
+            if (name.find('\\') != std::string_view::npos) return false;
+            p = space(p, end);
+            if (p == end || *p != ':') return false;
+            const char* value = space(p + 1, end);
+            if (!(p = skipValue(value, end))) return false;
+            members.push_back({name, std::string_view(value, p - value)});
+            p = space(p, end);
+            if (p == end) return false;
+            if (*p == '}') return space(p + 1, end) == end;
+            if (*p != ',') return false;
+            p = space(p + 1, end);
+        }
+    }
+
+    // The value of the last member called `key`, as the DOM would keep it; empty for none.
+    std::string_view last(std::string_view key) const {
+        for (auto m = members.rbegin(); m != members.rend(); ++m) {
+            if (m->key == key) return m->value;
+        }
+        return {};
+    }
+
+private:
+    struct Member {
+        std::string_view key;
+        std::string_view value;
+    };
+    std::vector<Member> members;
+};
+
+// A document's routing: just those four values parsed when the outline is there, the whole
+// document otherwise.
+bool routeOf(std::string_view text, const Outline* top, Routing& out) {
+    out = Routing();
+    RoutingReader reader(out);
+    if (!top) return json::sax_parse(text.data(), text.data() + text.size(), &reader);
+    for (const char* name : {packages_object, exclude_list, active_key, match_object}) {
+        const std::string_view value = top->last(name);
+        if (value.empty()) continue;
+        reader.bare(name);
+        if (!json::sax_parse(value.data(), value.data() + value.size(), &reader)) return false;
+    }
+    return true;
+}
+
+} // namespace
+
+namespace {
+
+// Where the ROM keeps each Build field, the keys tried in order. A generated build.prop names
+// only its own partition's copy of a product key - ro.product.vendor.brand, ro.product.system.brand -
+// and init derives ro.product.brand from them, the vendor's first. TIME, SDK_INT and
+// SDK_INT_FULL are read as text and converted after.
+enum class From : uint8_t { System, Vendor, Boot };
+
+struct RomKey {
+    From from;
+    const char* key;
+};
+
+struct RomField {
+    size_t field;
+    RomKey keys[3];
+};
+
+constexpr RomField kRomFields[] = {
+    {fieldOf("BRAND"),
+     {{From::System, "ro.product.brand"}, {From::Vendor, "ro.product.vendor.brand"}, {From::System, "ro.product.system.brand"}}},
+    {fieldOf("DEVICE"),
+     {{From::System, "ro.product.device"}, {From::Vendor, "ro.product.vendor.device"}, {From::System, "ro.product.system.device"}}},
+    {fieldOf("MANUFACTURER"),
+     {{From::System, "ro.product.manufacturer"}, {From::Vendor, "ro.product.vendor.manufacturer"}, {From::System, "ro.product.system.manufacturer"}}},
+    {fieldOf("MODEL"),
+     {{From::System, "ro.product.model"}, {From::Vendor, "ro.product.vendor.model"}, {From::System, "ro.product.system.model"}}},
+    {fieldOf("PRODUCT"),
+     {{From::System, "ro.product.name"}, {From::Vendor, "ro.product.vendor.name"}, {From::System, "ro.product.system.name"}}},
+    {fieldOf("FINGERPRINT"), {{From::System, "ro.build.fingerprint"}}},
+    {fieldOf("BOARD"), {{From::Vendor, "ro.product.board"}, {From::System, "ro.product.board"}}},
+    {fieldOf("BOOTLOADER"), {{From::Boot, "androidboot.bootloader"}}},
+    {kHardware, {{From::Boot, "androidboot.hardware"}, {From::Vendor, "ro.hardware"}}},
+    {fieldOf("ID"), {{From::System, "ro.build.id"}}},
+    {fieldOf("DISPLAY"), {{From::System, "ro.build.display.id"}}},
+    {fieldOf("HOST"), {{From::System, "ro.build.host"}}},
+    {kOdmSku, {{From::Boot, "androidboot.product.hardware.sku"}}},
+    {kSku, {{From::Boot, "androidboot.hardware.sku"}}},
+    {fieldOf("USER"), {{From::System, "ro.build.user"}}},
+    {kTags, {{From::System, "ro.build.tags"}}},
+    {kType, {{From::System, "ro.build.type"}}},
+    {kTime, {{From::System, "ro.build.date.utc"}}},
+    {fieldOf("INCREMENTAL"), {{From::System, "ro.build.version.incremental"}}},
+    {fieldOf("SECURITY_PATCH"), {{From::System, "ro.build.version.security_patch"}}},
+    {kCodename, {{From::System, "ro.build.version.codename"}}},
+    {kRelease, {{From::System, "ro.build.version.release"}}},
+    {kSdk, {{From::System, "ro.build.version.sdk"}}},
+    {kSdkInt, {{From::System, "ro.build.version.sdk"}}},
+    {kSdkIntFull, {{From::System, "ro.build.version.sdk_full"}}},
+    {kReleaseOrCodename, {{From::System, "ro.build.version.release_or_codename"}}},
+    {kReleaseOrPreviewDisplay, {{From::System, "ro.build.version.release_or_preview_display"}}},
+};
+static_assert(std::size(kRomFields) == kFieldCount, "one RomField per kBuildFields row");
+
+constexpr size_t kBrand = fieldOf("BRAND");
+constexpr size_t kDevice = fieldOf("DEVICE");
+constexpr size_t kFingerprint = fieldOf("FINGERPRINT");
+constexpr size_t kId = fieldOf("ID");
+constexpr size_t kIncremental = fieldOf("INCREMENTAL");
+
+} // namespace
+
+void scanRomBuild(DeviceInfo& info, const char* system_path, const char* vendor_path) {
+    io::MappedFile props[2];
+    props[static_cast<size_t>(From::System)].open(system_path);
+    props[static_cast<size_t>(From::Vendor)].open(vendor_path);
+    std::string value[kFieldCount];
+    for (const RomField& rom : kRomFields) {
+        for (const RomKey& k : rom.keys) {
+            if (!k.key || !value[rom.field].empty()) break;
+            value[rom.field] = k.from == From::Boot ? bootValue(k.key) : propValue(props[static_cast<size_t>(k.from)], k.key);
+        }
+    }
+    // What init and Build fill in when the ROM leaves them out.
+    std::string& fingerprint = value[kFingerprint];
+    if (value[kReleaseOrCodename].empty() && !value[kRelease].empty()) {
+        value[kReleaseOrCodename] = std::string(releaseOrCodename(value[kCodename], value[kRelease]));
+    }
+    if (value[kReleaseOrPreviewDisplay].empty()) value[kReleaseOrPreviewDisplay] = value[kReleaseOrCodename];
+    if (fingerprint.empty()) {
+        const std::string parts[] = {value[kBrand], value[kProduct],     value[kDevice], value[kReleaseOrCodename],
+                                     value[kId],    value[kIncremental], value[kType],   value[kTags]};
+        if (std::none_of(std::begin(parts), std::end(parts), [](const std::string& v) { return v.empty(); })) {
+            fingerprint = parts[0] + "/" + parts[1] + "/" + parts[2] + ":" + parts[3] + "/" + parts[4] + "/" + parts[5] +
+                          ":" + parts[6] + "/" + parts[7];
+        }
+    }
+
+    std::fill(std::begin(info.str), std::end(info.str), std::string_view());
+    std::fill(std::begin(info.num), std::end(info.num), 0);
+    int sdk = 0;
+    if (parseNumber(value[kSdkInt], sdk)) info.num[kSdkInt] = sdk;
+    int64_t time = 0;
+    if (parseNumber(value[kTime], time)) info.num[kTime] = time * 1000;
+    // "36.1", as SDK_FULL in a profile.
+    const std::string_view full = value[kSdkIntFull];
+    int major = 0, minor = 0;
+    const size_t dot = full.find('.');
+    if (parseNumber(full.substr(0, dot), major) &&
+        (dot == std::string_view::npos || parseNumber(full.substr(dot + 1), minor))) {
+        info.num[kSdkIntFull] = int64_t{major} * 100000 + minor;
+    } else {
+        info.num[kSdkIntFull] = info.num[kSdkInt] * 100000;
+    }
+
+    size_t capacity = 0;
+    for (size_t f = 0; f < kFieldCount; f++) capacity += value[f].size() + 1;
+    info.arena.reset(capacity);
+    for (size_t f = 0; f < kFieldCount; f++) {
+        if (kBuildFields[f].kind == Kind::Str) info.str[f] = info.arena.keep(value[f]);
+    }
+}
+
+bool readRouting(const char* path, Routing& out) {
+    io::MappedFile file;
+    if (!file.open(path)) return false;
+    const std::string_view text(file.data(), file.size());
+    Outline top;
+    return routeOf(text, top.open(text) ? &top : nullptr, out);
+}
+
+std::string_view matchProfile(const std::vector<MatchRule>& rules, const Hardware& hw, HwKey* by) {
+    // Exact names first, then the longest prefix: a rule for one model beats one for its
+    // family. Hundreds of rules are one pass over short strings; the result is compiled into
+    // the image, so zygote normally does not even do that.
+    for (size_t k = 0; k < static_cast<size_t>(HwKey::Count); k++) {
+        const HwKey key = static_cast<HwKey>(k);
+        const std::string& value = hw[key];
+        if (value.empty()) continue;
+        const MatchRule* exact = nullptr;
+        const MatchRule* prefix = nullptr;
+        for (const MatchRule& r : rules) {
+            if (r.key != key) continue;
+            if (r.pattern == value) {
+                exact = &r;
+            } else if (!r.pattern.empty() && r.pattern.back() == '*' &&
+                       value.compare(0, r.pattern.size() - 1, r.pattern, 0, r.pattern.size() - 1) == 0 &&
+                       (!prefix || r.pattern.size() >= prefix->pattern.size())) {
+                prefix = &r;
+            }
+        }
+        if (const MatchRule* hit = exact ? exact : prefix) {
+            if (by) *by = key;
+            return hit->profile;
+        }
+    }
+    return {};
+}
+
+DefaultPick defaultPick(const Routing& routing, const Hardware& hw) {
+    DefaultPick pick;
+    pick.active = routing.active;
+    pick.matched = matchProfile(routing.rules, hw, &pick.by);
+    return pick;
+}
+
+std::string defaultProfile(const char* path) {
+    Routing routing;
+    if (!readRouting(path, routing)) return {};
+    const DefaultPick pick = defaultPick(routing, routing.rules.empty() ? Hardware() : readHardware());
+    for (const std::string_view name : {pick.active, pick.matched}) {
+        DeviceInfo info{};
+        if (!name.empty() && loadProfile(path, info, nullptr, nullptr, Selector{name})) return std::string(name);
+    }
+    return {};
+}
+
+bool loadProfile(const char* path, DeviceInfo& spoof_info, Stats* stats, std::string* error, const Selector& select) {
+    Stats unused;
+    Stats& cost = stats ? *stats : unused;
+    uint64_t t = Stats::now();
+    trace::Scope slice("parse");
+
+    io::UniqueFd fd(io::openRead(path));
+    struct stat st;
+    if (!fd || fstat(fd.get(), &st) != 0) {
+        ERROR_LOG("Failed to open: %s", path);
+        if (error) *error = std::string("cannot open ") + path;
+        return false;
+    }
+
+    // Read first, so the arena can be sized before anything is parsed into it.
+    cost.lap(PH_OPEN, t);
+    const RomVersion rom = readRomVersion();
+    cost.lap(PH_ROM, t);
+    const VersionPolicy policy = readVersionPolicy();
+    cost.lap(PH_POLICY, t);
+
+    // Unescaping never makes a JSON string longer, and its quotes pay for the NUL, so every
+    // value in the document fits in the document's size. The rest is for what gets derived:
+    // the ROM's release or codename and SDK as text. The text itself is read into the
+    // scratch space right behind the arena - one allocation for the lot.
+    const size_t size = static_cast<size_t>(st.st_size);
+    Arena& arena = spoof_info.arena;
+    char* text = arena.reset(size + rom.release.size() + rom.codename.size() + 32, size);
+    const size_t len = io::readFull(fd.get(), text, size);
+    cost.bytes = static_cast<uint32_t>(len);
+    cost.lap(PH_OPEN, t);
+
+    auto configError = [error, &select](std::string why) {
+        if (!select.profile.empty()) why = "profile \"" + std::string(select.profile) + "\": " + why;
+        ERROR_LOG("Config error: %s", why.c_str());
+        if (error) *error = std::move(why);
+        return false;
+    };
+    // An outline of the document first, which parses nothing: the objects this takes are then
+    // parsed on their own and the rest - the library above all - is only stepped over. Anything
+    // the outline cannot vouch for, from broken brackets to an escaped key, gets the full parse.
+    const std::string_view doc(text, len);
+    Outline top;
+    const bool outlined = top.open(doc);
+
+    Routing routing;
+    const bool routed = routeOf(doc, outlined ? &top : nullptr, routing);
+    if (!routed) routing = Routing();      // the profile's parse below says what is wrong
+    Pick pick;
+    if (routed && select.process) pick = pickFor(routing, select.process);
+    if (pick.excluded) {
+        // The ROM's own values, not whatever the child holds: zygote may have read its Build
+        // from props that already carried the spoof. Drops the text, which is done with.
+        scanRomBuild(spoof_info);
+        cost.lap(PH_ROM, t);
+        return true;
+    }
+
+    // Each pass keeps only the values of its own object, so a second one still fits the arena.
+    RawKeys raw;
+    std::optional<ProfileReader> reader;
+    // Where profile `name` is, to be parsed on its own: empty when it is not there. false
+    // sends it to the full parse. The library is outlined only for a profile that is in it,
+    // and even then its entries are stepped over one by one, never parsed.
+    auto locate = [&](std::string_view name, std::string_view& value) {
+        if (!outlined) return false;
+        value = top.last(name.empty() ? LOG_TAG : profiles_object);
+        if (name.empty()) return true;
+        if (value.empty() || value.front() != '{') {
+            value = {};
+            return true;
+        }
+        Outline library;
+        if (!library.open(value)) return false;
+        value = library.last(name);
+        return true;
+    };
+    auto read = [&](std::string_view name) {
+        reader.emplace(spoof_info, raw, name);
+        std::string_view value;
+        if (!locate(name, value)) return json::sax_parse(text, text + len, &*reader) && !reader->mistyped();
+        if (value.empty()) return true;
+        reader->bare();
+        return json::sax_parse(value.data(), value.data() + value.size(), &*reader) && !reader->mistyped();
+    };
+    if (!select.profile.empty()) {
+        if (!read(select.profile)) return configError(reader->error);
+        if (!reader->found()) return configError(std::string("not in ") + profiles_object);
+    } else {
+        // The process's profile, then the active one, then the one the hardware matches, then
+        // "COPG-VD": the first that is there and reads.
+        bool done = false;
+        const DefaultPick fallback = defaultPick(routing, routing.rules.empty() ? Hardware() : readHardware());
+        // A name is tried once: the arena only has room for one pass over each object.
+        std::string_view tried[3];
+        size_t tries = 0;
+        for (const std::string_view name : {pick.profile, fallback.active, fallback.matched}) {
+            if (name.empty() || done || std::find(tried, tried + tries, name) != tried + tries) continue;
+            tried[tries++] = name;
+            const bool ok = read(name);
+            done = ok && reader->found();
+            if (!done) {
+                ERROR_LOG("%s: profile \"%.*s\" %s, falling back", select.process ? select.process : active_key,
+                          static_cast<int>(name.size()), name.data(), ok ? "does not exist" : reader->error.c_str());
+            }
+        }
+        if (!done && !read({})) return configError(reader->error);
+    }
+    std::string_view* str = spoof_info.str;
+    int64_t* num = spoof_info.num;
+    if (!reader->has(kOdmSku)) str[kOdmSku] = str[kProduct];
+    if (!reader->has(kSku)) str[kSku] = str[kHardware];
+    str[kTags] = "release-keys";
+    str[kType] = "user";
+
+    auto notNumber = [&configError](const char* key) { return configError(std::string(key) + " is not a number"); };
+
+    if (reader->has(R_TIMESTAMP)) {
+        if (!parseNumber(raw[R_TIMESTAMP], num[kTime])) return notNumber("TIMESTAMP");
+        num[kTime] *= 1000;
+    }
+
+    // --- the version group, and only what the semaphore lets through ---
+    auto allowed = [&rom, policy](const char* field, std::string_view value) {
+        if (policy == VersionPolicy::Force) return true;
+        if (policy == VersionPolicy::Never) return false;
+        // Rom: never above the ROM. Raising the SDK is what makes apps call APIs
+        // the framework does not have; lowering it only makes them ask for less.
+        const std::string f(field);
+        if (f == "SDK_INT" || f == "SDK_FULL") {
+            int sdk;
+            return rom.sdk != 0 && parseNumber(value, sdk) && sdk <= rom.sdk;
+        }
+        if (f == "ANDROID_VERSION") return !rom.release.empty() && value == rom.release;
+        if (f == "CODENAME") return !rom.codename.empty() && value == rom.codename;
+        return false;
+    };
+
+    if (!trim(raw[R_CODENAME]).empty() && allowed("CODENAME", raw[R_CODENAME])) {
+        str[kCodename] = raw[R_CODENAME];
+    }
+
+    if (reader->has(R_ANDROID_VERSION) && allowed("ANDROID_VERSION", raw[R_ANDROID_VERSION])) {
+        str[kRelease] = raw[R_ANDROID_VERSION];
+    }
+
+    if (reader->has(R_SDK_INT) && allowed("SDK_INT", raw[R_SDK_INT])) {
+        int sdk;
+        if (!parseNumber(raw[R_SDK_INT], sdk)) return notNumber("SDK_INT");
+        num[kSdkInt] = sdk;
+        str[kSdk] = arena.keep(std::to_string(sdk));
+        if (!str[kSdk].data()) return configError("no room left for SDK");
+    }
+
+    if (reader->has(R_SDK_FULL) && allowed("SDK_FULL", raw[R_SDK_FULL])) {
+        const std::string_view value = raw[R_SDK_FULL];
+        const size_t dot_position = value.find('.');
+        int major, minor = 0;
+        if (!parseNumber(value.substr(0, dot_position), major)) return notNumber("SDK_FULL");
+        if (dot_position != std::string_view::npos && !parseNumber(value.substr(dot_position + 1), minor)) {
+            return notNumber("SDK_FULL");
+        }
+        num[kSdkIntFull] = major * 100000 + minor;
+    }
+    if (!num[kSdkIntFull] && num[kSdkInt]) {
+        num[kSdkIntFull] = num[kSdkInt] * 100000;
+    }
+
+    // Derived from what actually got through, by the AOSP rule. Left empty when the
+    // version is not spoofed at all, so the framework keeps its own correct values.
+    if (!str[kCodename].empty() || !str[kRelease].empty()) {
+        const std::string_view cod = str[kCodename].empty() ? arena.keep(rom.codename) : str[kCodename];
+        const std::string_view rel = str[kRelease].empty() ? arena.keep(rom.release) : str[kRelease];
+        if (!cod.data() || !rel.data()) return configError("no room left for RELEASE_OR_CODENAME");
+        str[kReleaseOrCodename] = releaseOrCodename(cod, rel);
+        str[kReleaseOrPreviewDisplay] = str[kReleaseOrCodename];
+    }
+    cost.lap(PH_PARSE, t);
+    return true;
+}
+
+ProfileView viewOf(const DeviceInfo& info) {
+    ProfileView view;
+    for (size_t f = 0; f < kFieldCount; f++) {
+        if (kBuildFields[f].kind == Kind::Str) {
+            if (!trim(info.str[f]).empty()) view.str[f] = info.str[f].data();
+        } else {
+            view.num[f] = info.num[f];
+        }
+    }
+    return view;
+}
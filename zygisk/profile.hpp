@@ -0,0 +1,182 @@
+#pragma once
+
+#include "fields.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+static constexpr const char* config_file = "/data/adb/COPG-VD.json";
+// Next to "COPG-VD", the default profile: more profiles by name, and which processes get
+// which. A process is looked up by its full name, then by what comes before its ':'.
+static constexpr const char* profiles_object = "COPG-VD-Profiles";
+static constexpr const char* packages_object = "COPG-VD-Packages";
+// Processes that must see the real device, matched the same way: their Build gets the ROM's
+// own values back.
+static constexpr const char* exclude_list = "COPG-VD-Exclude";
+// The name of a profiles_object entry that stands in for "COPG-VD", so one file can carry a
+// library of devices and switch between them with one line.
+static constexpr const char* active_key = "COPG-VD-Active";
+// Picks the default profile by what the device really is, when active_key does not:
+//   {"device": {"comet": "pixel9fold", "SM-S92*": "s24"}, "hardware": {...}, "board": {...}}
+// device first, then hardware, then board; an exact name before the longest '*' prefix.
+static constexpr const char* match_object = "COPG-VD-Match";
+// What the ROM really is. NEVER a system property: the module rewrites those very props, so
+// asking the system would be asking our own lie. /build.prop does not exist on these devices;
+// on a custom ROM the fingerprint line inside this file is stale, but ro.build.version.* is good.
+static constexpr const char* rom_prop_file = "/system/build.prop";
+static constexpr const char* version_policy_file = "/data/adb/modules/COPG-VD/.spoof.version";
+// What readRomVersion() last found in rom_prop_file, and which rom_prop_file that was.
+// Written by copgvd only; zygote just reads it.
+static constexpr const char* rom_cache_file = "/data/adb/modules/COPG-VD/.rom.cache";
+// The real hardware, for the same reason: the vendor partition's own build.prop, and what
+// the bootloader passed to the kernel.
+static constexpr const char* vendor_prop_file = "/vendor/build.prop";
+static constexpr const char* bootconfig_file = "/proc/bootconfig";
+static constexpr const char* cmdline_file = "/proc/cmdline";
+// What readHardware() last found, and which vendor_prop_file that was. Written by copgvd only.
+static constexpr const char* hw_cache_file = "/data/adb/modules/COPG-VD/.hw.cache";
+
+// The Android version belongs to the ROM, not to the build being spoofed. An app told the SDK
+// is newer than the framework really is calls APIs that do not exist: Google's apps crash, the
+// device reboots, and it repeats - a softloop, which leaves nothing in the boot logs.
+//   Never = the version group is never applied (default)
+//   Rom   = only what does not exceed the ROM (in practice, lowering the SDK)
+//   Force = whatever the config says
+enum class VersionPolicy { Never, Rom, Force };
+
+struct RomVersion {
+    std::string release;
+    std::string codename;
+    int sdk = 0;
+};
+
+// What match_object matches on, in that order.
+enum class HwKey : uint8_t { Device, Hardware, Board, Count };
+
+struct Hardware {
+    // ro.product.vendor.device; androidboot.hardware, else ro.hardware; ro.product.board,
+    // else ro.board.platform.
+    std::string value[static_cast<size_t>(HwKey::Count)];
+    std::string& operator[](HwKey key) { return value[static_cast<size_t>(key)]; }
+    const std::string& operator[](HwKey key) const { return value[static_cast<size_t>(key)]; }
+};
+
+// "device", "hardware" or "board": the keys of match_object.
+const char* hwKeyName(HwKey key);
+
+// A single allocation that strings are copied into and never move from, so views of them
+// stay good for as long as the arena lives. Each copy is followed by a NUL.
+class Arena {
+public:
+    // Drops what it held and makes room for `capacity` bytes of strings. The `scratch`
+    // bytes after them, returned, are the caller's until the next reset.
+    char* reset(size_t capacity, size_t scratch = 0);
+
+    // A null view - data() is nullptr - when it does not fit, which the caller must report:
+    // an empty value would silently stand in for the real one. Callers size the arena so
+    // that it always fits.
+    std::string_view keep(std::string_view s);
+
+private:
+    std::unique_ptr<char[]> buf;
+    size_t cap = 0;
+    size_t used = 0;
+};
+
+// Resolved values, one slot per kBuildFields row. Every string is NUL-terminated: it lives
+// in `arena` or is a literal. A blank string is never written.
+struct DeviceInfo {
+    std::string_view str[kFieldCount];
+    int64_t num[kFieldCount] = {};
+    Arena arena;
+};
+
+// What the module applies, whichever way the profile was loaded, again one slot per row:
+// str for Kind::Str rows, num for the others. A null string means "leave the framework's
+// own value alone", and so does a 0 number.
+struct ProfileView {
+    const char* str[kFieldCount] = {};
+    int64_t num[kFieldCount] = {};
+};
+
+std::string_view trim(std::string_view str);
+// rom_prop_file's ro.build.version.*, from rom_cache_file when it still describes it.
+RomVersion readRomVersion();
+// The scan behind it, of `path` and never cached. Empty values when it cannot be read.
+RomVersion scanRomVersion(const char* path);
+VersionPolicy readVersionPolicy();
+// vendor_prop_file and the bootloader's, from hw_cache_file when it still describes them.
+Hardware readHardware();
+// The ROM's own Build, what an excluded process gets: from the build.props and the bootloader,
+// never from the props, which may carry the spoof. Never cached; a field the files do not
+// give is left blank, and the framework keeps its value.
+void scanRomBuild(DeviceInfo& info, const char* system_path = rom_prop_file, const char* vendor_path = vendor_prop_file);
+
+struct Stats;
+
+// Which object loadProfile() reads: the default profile - active_key's, else the one
+// match_object gives this hardware, else "COPG-VD" - unless `profile` names an entry of
+// profiles_object or packages_object maps `process` to one. An excluded `process` gets
+// scanRomBuild(). A process's own entry wins over its package's; in exclude_list over
+// packages_object.
+struct Selector {
+    std::string_view profile;
+    const char* process = nullptr;
+};
+
+// Parses the selected profile of `path` and applies the version policy against the ROM.
+// The file is read once, and every value ends up in one allocation, info.arena. Only the
+// objects it needs are parsed: the rest of the document is stepped over by a byte scan.
+// false when the file cannot be opened or parsed, or `select.profile` is not in it; the reason
+// is logged, and copied to `error` when given. A process mapped to a profile that is missing
+// or broken gets the default one, and a missing or broken active or matched profile is
+// "COPG-VD". `stats`, when given, gets the time each step took added to it.
+bool loadProfile(const char* path, DeviceInfo& info, Stats* stats = nullptr, std::string* error = nullptr,
+                 const Selector& select = {});
+
+// One member of match_object: hardware whose `key` is `pattern` gets `profile`. A pattern
+// ending in '*' is a prefix.
+struct MatchRule {
+    HwKey key;
+    std::string pattern;
+    std::string profile;
+};
+
+// packages_object, exclude_list, active_key and match_object, in file order, repeats
+// included. Members that are not strings are left out.
+struct Routing {
+    std::vector<std::pair<std::string, std::string>> profiles;      // process, profile
+    std::vector<std::string> excluded;
+    std::string active;
+    std::vector<MatchRule> rules;
+};
+
+// The profile `rules` give `hw`, or empty; `by` gets the key that decided. Later repeats of
+// a pattern win, as in the DOM.
+std::string_view matchProfile(const std::vector<MatchRule>& rules, const Hardware& hw, HwKey* by = nullptr);
+
+// false when the file cannot be read or parsed.
+bool readRouting(const char* path, Routing& out);
+
+// Where the default profile comes from, most wanted first: active_key's entry of
+// profiles_object, then the one match_object gives the hardware. Either may be empty. The
+// first that is there and reads is the default; "COPG-VD" when neither is. Points into
+// `routing`.
+struct DefaultPick {
+    std::string_view active;
+    std::string_view matched;
+    HwKey by = HwKey::Count;        // what `matched` was matched on
+};
+DefaultPick defaultPick(const Routing& routing, const Hardware& hw);
+
+// The profiles_object entry the module applies to `path` by default, or empty for "COPG-VD":
+// the one loadProfile() picks when no process or profile is named. For the root side, which
+// reads the document some other way and must not disagree with the Build fields.
+std::string defaultProfile(const char* path);
+
+// Points into `info`, which must outlive the view. Blank strings come out as null.
+ProfileView viewOf(const DeviceInfo& info);
@@ -0,0 +1,152 @@
+#include "prophook.hpp"
+#include "log.hpp"
+#include <cstring>
+#include <link.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __ANDROID__
+#include <sys/system_properties.h>
+#endif
+
+namespace prophook {
+
+#ifdef __ANDROID__
+namespace {
+
+using Callback = void (*)(void* cookie, const char* name, const char* value, uint32_t serial);
+
+const char* const kConsumers[] = {"libandroid_runtime.so", "libbase.so", "libcutils.so"};
+// The same library can be loaded from the system and from an APEX.
+constexpr size_t kMaxLibraries = 8;
+
+// Written once, before the hooks are committed, and never again.
+const image::PropSlot* table = nullptr;
+const char* strings = nullptr;
+uint32_t mask = 0;
+
+// libc's own until Zygisk hands back what it replaced, so a hook that is only half committed
+// still reads the real props.
+int (*real_get)(const char*, char*) = __system_property_get;
+void (*real_read_callback)(const prop_info*, Callback, void*) = __system_property_read_callback;
+
+// The table always has an empty slot, so the probe ends.
+const image::PropSlot* lookup(const char* name) {
+    const uint32_t hash = image::propHash(name, strlen(name));
+    for (uint32_t i = hash & mask;; i = (i + 1) & mask) {
+        const image::PropSlot& slot = table[i];
+        if (slot.name == image::kEmpty) return nullptr;
+        if (slot.hash == hash && !strcmp(strings + slot.name, name)) return &slot;
+    }
+}
+
+int hookedGet(const char* name, char* value) {
+    const image::PropSlot* slot = name ? lookup(name) : nullptr;
+    if (!slot) return real_get(name, value);
+    // Cut like bionic cuts a long value for this API.
+    const uint32_t n = slot->length < PROP_VALUE_MAX ? slot->length : PROP_VALUE_MAX - 1;
+    memcpy(value, strings + slot->value, n);
+    value[n] = '\0';
+    return static_cast<int>(n);
+}
+
+struct Relay {
+    Callback callback;
+    void* cookie;
+};
+
+// The prop is only known by name inside the read: the real one runs, and its value is
+// swapped on the way out.
+void relay(void* cookie, const char* name, const char* value, uint32_t serial) {
+    const Relay* r = static_cast<const Relay*>(cookie);
+    const image::PropSlot* slot = name ? lookup(name) : nullptr;
+    r->callback(r->cookie, name, slot ? strings + slot->value : value, serial);
+}
+
+void hookedReadCallback(const prop_info* pi, Callback callback, void* cookie) {
+    Relay r{callback, cookie};
+    real_read_callback(pi, relay, &r);
+}
+
+// Every string ends inside the table and one slot at least is empty; then the copy.
+bool copy(const image::Header& h, const image::Record& r) {
+    const image::PropSlot* src = image::propsOf(h, r);
+    if (!src) return false;
+    const image::PropTable& t = r.props;
+    const char* text = reinterpret_cast<const char*>(src + t.slots);
+    uint32_t used = 0;
+    for (uint32_t i = 0; i < t.slots; i++) {
+        const image::PropSlot& s = src[i];
+        if (s.name == image::kEmpty) continue;
+        used++;
+        if (s.name >= t.bytes || !memchr(text + s.name, '\0', t.bytes - s.name) ||
+            s.value >= t.bytes || t.bytes - s.value <= s.length || text[s.value + s.length] != '\0') {
+            return false;
+        }
+    }
+    if (used == t.slots) return false;
+
+    const size_t slots_size = size_t{t.slots} * sizeof(image::PropSlot);
+    const size_t size = slots_size + t.bytes;
+    void* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) return false;
+    memcpy(mem, src, size);
+    mprotect(mem, size, PROT_READ);
+    table = static_cast<const image::PropSlot*>(mem);
+    strings = static_cast<const char*>(mem) + slots_size;
+    mask = t.slots - 1;
+    return true;
+}
+
+struct Libraries {
+    dev_t dev[kMaxLibraries];
+    ino_t ino[kMaxLibraries];
+    size_t count = 0;
+};
+
+// The linker's own list: no /proc/self/maps to read, and only the few matches are stat'ed.
+int visit(dl_phdr_info* info, size_t, void* data) {
+    auto libs = static_cast<Libraries*>(data);
+    const char* path = info->dlpi_name;
+    if (!path || !*path || libs->count == kMaxLibraries) return 0;
+    const char* slash = strrchr(path, '/');
+    const char* base = slash ? slash + 1 : path;
+    for (const char* lib : kConsumers) {
+        struct stat st;
+        if (strcmp(base, lib) != 0 || stat(path, &st) != 0) continue;
+        libs->dev[libs->count] = st.st_dev;
+        libs->ino[libs->count] = st.st_ino;
+        libs->count++;
+    }
+    return 0;
+}
+
+} // namespace
+#endif
+
+bool install(zygisk::Api* api, const image::Header& h, const char* process) {
+#ifndef __ANDROID__
+    // No bionic to hook on a host build: the library unloads as it would without a table.
+    (void)api;
+    (void)h;
+    (void)process;
+    return false;
+#else
+    const image::Record* record = image::recordOf(h, process);
+    if (!record || !image::propsOf(h, *record)) return false;
+    Libraries libs;
+    dl_iterate_phdr(visit, &libs);
+    if (libs.count == 0 || !copy(h, *record)) return false;
+
+    for (size_t i = 0; i < libs.count; i++) {
+        api->pltHookRegister(libs.dev[i], libs.ino[i], "__system_property_get", reinterpret_cast<void*>(hookedGet),
+                             reinterpret_cast<void**>(&real_get));
+        api->pltHookRegister(libs.dev[i], libs.ino[i], "__system_property_read_callback",
+                             reinterpret_cast<void*>(hookedReadCallback), reinterpret_cast<void**>(&real_read_callback));
+    }
+    // Some of it may be in place even then: the library stays loaded either way.
+    if (!api->pltHookCommit()) ERROR_LOG("Failed to hook the prop reads of %zu libraries", libs.count);
+    return true;
+#endif
+}
+
+} // namespace prophook
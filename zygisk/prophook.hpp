@@ -0,0 +1,26 @@
+#pragma once
+
+#include "image.hpp"
+#include <zygisk.hpp>
+
+// The props the config maps, served to the app's own reads without touching the property
+// area: for a device where resetprop is off, or a prop cannot change for everyone. Opt-in
+// through hook_props_file, and only ever in an app that gets a profile.
+//
+// The table is the image's, built by copgvd for the profile the process gets - the default
+// one's from the same plan resetprop is fed - so the props never describe another device than
+// Build. The app gets a copy of its own, page-aligned and read-only once filled. A read is
+// image::propHash() - the name's length and its first, middle and last eight bytes, mixed -
+// and a probe of a table at most half full: a name it does not have, nearly every read,
+// usually stops at the first slot. Bionic walks a trie under the prop's SELinux context and
+// then copies the value out under its serial.
+namespace prophook {
+
+// Hooks __system_property_get and __system_property_read_callback where the app's props are
+// read: libandroid_runtime (SystemProperties), libbase (GetProperty) and libcutils
+// (property_get). What the app loads later is its own. The table is that of `process`'s
+// record - see image::recordOf(). false when it has none, it is damaged or none of those
+// libraries is loaded; the library may be unloaded then, and only then.
+bool install(zygisk::Api* api, const image::Header& h, const char* process);
+
+} // namespace prophook
@@ -0,0 +1,315 @@
+#include "props.hpp"
+#include "image.hpp"
+#include "io.hpp"
+#include "log.hpp"
+#include "profile.hpp"
+#include <json.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <initializer_list>
+#include <iterator>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#ifdef __ANDROID__
+#include <sys/system_properties.h>
+#endif
+
+using json = nlohmann::json;
+
+namespace props {
+
+namespace {
+
+// The prop's value, empty when it does not exist. A lookup in the property area this process
+// already has mapped: no getprop, no IPC.
+std::string current(const std::string& name) {
+    std::string value;
+#ifdef __ANDROID__
+    if (const prop_info* pi = __system_property_find(name.c_str())) {
+        __system_property_read_callback(pi, [](void* cookie, const char*, const char* v, uint32_t) {
+            *static_cast<std::string*>(cookie) = v;
+        }, &value);
+    }
+#else
+    (void)name;
+#endif
+    return value;
+}
+
+bool allDigits(std::string_view s) {
+    return !s.empty() && s.find_first_not_of("0123456789") == std::string_view::npos;
+}
+
+// service.sh's version_allowed(): the same rules, against the same ROM version.
+bool versionAllowed(VersionPolicy policy, const RomVersion& rom, std::string_view key, std::string_view value) {
+    if (policy == VersionPolicy::Force) return true;
+    if (policy == VersionPolicy::Never) return false;
+    const std::string sdk = rom.sdk > 0 ? std::to_string(rom.sdk) : std::string();
+    if (key == "SDK_INT") {
+        if (!allDigits(value) || sdk.empty()) return false;
+        int n = 0;
+        const auto [last, ec] = std::from_chars(value.data(), value.data() + value.size(), n);
+        return ec == std::errc() && n <= rom.sdk;
+    }
+    if (key == "SDK_FULL") {
+        return !sdk.empty() && value.substr(0, sdk.size()) == sdk &&
+               (value.size() == sdk.size() || value[sdk.size()] == '.');
+    }
+    if (key == "ANDROID_VERSION") return value == rom.release;
+    if (key == "CODENAME") return value == rom.codename;
+    return false;
+}
+
+// `date -u -d @ts` under LC_ALL=C, which is what the build.prop dates look like.
+std::string buildDate(std::string_view timestamp) {
+    timestamp = trim(timestamp);
+    long long seconds = 0;
+    const char* end = timestamp.data() + timestamp.size();
+    const auto [last, ec] = std::from_chars(timestamp.data(), end, seconds);
+    if (ec != std::errc() || last != end) return {};
+    const time_t t = static_cast<time_t>(seconds);
+    struct tm tm;
+    char buf[64];
+    if (!gmtime_r(&t, &tm) || !strftime(buf, sizeof(buf), "%a %b %e %H:%M:%S UTC %Y", &tm)) return {};
+    return buf;
+}
+
+// awk -F'[:/]' over brand/product/device:release/id/incremental:type/tags, 1-based.
+std::string fingerprintPart(std::string_view fp, size_t n) {
+    for (size_t i = 1; i < n; i++) {
+        const size_t sep = fp.find_first_of(":/");
+        if (sep == std::string_view::npos) return {};
+        fp.remove_prefix(sep + 1);
+    }
+    return std::string(fp.substr(0, fp.find_first_of(":/")));
+}
+
+// The last value asked for a prop wins, in the position of the first.
+class Wanted {
+public:
+    Wanted() { std::fill(std::begin(position), std::end(position), kNone); }
+
+    void set(std::string_view name, const std::string& value) {
+        if (value.empty() || value.find('\n') != std::string::npos) return;
+        const size_t id = propId(name);
+        if (id == kPropCount) return;
+        if (position[id] == kNone) {
+            position[id] = list.size();
+            list.push_back({std::string(name), value});
+        } else {
+            list[position[id]].value = value;
+        }
+    }
+
+    void setAll(std::string_view props, const std::string& value) {
+        forEachProp(props, [&](std::string_view name) { set(name, value); });
+    }
+
+    std::vector<Change> list;
+
+private:
+    static constexpr size_t kNone = ~size_t{0};
+    size_t position[kPropCount];
+};
+
+bool run(const char* path, std::initializer_list<const char*> args) {
+    std::vector<char*> argv{const_cast<char*>(path)};
+    for (const char* arg : args) argv.push_back(const_cast<char*>(arg));
+    argv.push_back(nullptr);
+    const pid_t pid = fork();
+    if (pid < 0) return false;
+    if (pid == 0) {
+        execv(path, argv.data());
+        _exit(127);
+    }
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) return false;
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+constexpr char kStateMagic[] = "COPG-VD props 1";
+
+uint64_t valueHash(std::string_view value) {
+    return image::fnv1a64(value.data(), value.size());
+}
+
+// Everything plan() reads besides the props themselves, by identity rather than content, plus
+// the table it was planned with: none of it may have moved for a record to still hold.
+uint64_t inputsHash() {
+    struct {
+        io::Stamp config, policy, rom, manufacturer;
+        uint64_t table;
+    } inputs{io::stampOf(config_file), io::stampOf(version_policy_file), io::stampOf(rom_prop_file),
+             io::stampOf(skip_manufacturer_file), kPropCount};
+    for (std::string_view name : kPropNames) inputs.table = (inputs.table ^ phash::hash(name)) * 1099511628211ull;
+    return image::fnv1a64(&inputs, sizeof(inputs));
+}
+
+} // namespace
+
+bool plan(const char* config, Plan& out, std::string_view profile) {
+#ifndef __ANDROID__
+    ERROR_LOG("No system properties to compare against on this platform");
+    return false;
+#endif
+    io::MappedFile file;
+    if (!file.open(config)) {
+        ERROR_LOG("Failed to open: %s", config);
+        return false;
+    }
+    // The profile the module gives Build - the default one unless named - so the props never
+    // tell another story.
+    const std::string chosen = profile.empty() ? defaultProfile(config) : std::string(profile);
+    const json doc = json::parse(file.data(), file.data() + file.size(), nullptr, false);
+    const json* object = nullptr;
+    const json* within = &doc;
+    if (!chosen.empty() && doc.is_object()) {
+        const auto library = doc.find(profiles_object);
+        within = library != doc.end() ? &*library : nullptr;
+    }
+    if (within && within->is_object()) {
+        const auto it = within->find(chosen.empty() ? std::string(LOG_TAG) : chosen);
+        if (it != within->end()) object = &*it;
+    }
+    if (!object || !object->is_object()) {
+        ERROR_LOG("Config error: no %s object in %s", chosen.empty() ? LOG_TAG : chosen.c_str(), config);
+        return false;
+    }
+    auto value = [object](const char* key) {
+        const auto it = object->find(key);
+        return it != object->end() && it->is_string() ? it->get_ref<const std::string&>() : std::string();
+    };
+
+    const RomVersion rom = readRomVersion();
+    const VersionPolicy policy = readVersionPolicy();
+    const bool manufacturer = access(skip_manufacturer_file, F_OK) != 0;
+
+    Wanted wanted;
+    for (size_t m = 0; m < kMappingCount; m++) {
+        const Mapping& map = kMappings[m];
+        const std::string_view key = map.key;
+        if (map.rule == Rule::Optional && !manufacturer) continue;
+
+        std::string v = value(map.key);
+        if (map.rule == Rule::Fixed) v = key == "TAGS" ? "release-keys" : "user";
+        if (map.rule == Rule::Version && !v.empty() && !versionAllowed(policy, rom, key, v)) v.clear();
+        if (v.empty()) continue;
+
+        if (key == "SECURITY_PATCH") {
+            out.security_patch = v;
+        } else if (key == "TIMESTAMP") {
+            wanted.setAll(kGroups[G_BUILD_DATE], buildDate(v));
+        } else if (key == "SDK_INT") {
+            wanted.setAll(kGroups[G_SDK_FULL_FROM_SDK_INT], v + ".0");
+        } else if (key == "FINGERPRINT") {
+            const std::string flavor = fingerprintPart(v, 2) + "-" + fingerprintPart(v, 7);
+            wanted.setAll(kGroups[G_BUILD_DESCRIPTION], flavor + " " + fingerprintPart(v, 4) + " " +
+                       fingerprintPart(v, 5) + " " + fingerprintPart(v, 6) + " " + fingerprintPart(v, 8));
+            wanted.setAll(kGroups[G_BUILD_FLAVOR], flavor);
+        }
+        wanted.setAll(map.props, v);
+    }
+
+    // Computed once, from whatever ended up effective: "REL" means a release build, and then
+    // it is the release number that belongs here, never the codename.
+    std::string codename = value("CODENAME");
+    std::string release = value("ANDROID_VERSION");
+    if (!versionAllowed(policy, rom, "CODENAME", codename)) codename.clear();
+    if (!versionAllowed(policy, rom, "ANDROID_VERSION", release)) release.clear();
+    if (codename.empty()) codename = rom.codename;
+    if (release.empty()) release = rom.release;
+    wanted.setAll(kGroups[G_RELEASE_OR_CODENAME], codename.empty() || codename == "REL" ? release : codename);
+
+    // Only props that exist: resetprop -n would create the rest, and a prop no real build
+    // has is a tell of its own.
+    for (Change& c : wanted.list) {
+        const std::string now = current(c.name);
+        if (now.empty()) continue;
+        (now == c.value ? out.held : out.changes).push_back(std::move(c));
+    }
+    return true;
+}
+
+bool apply(const char* resetprop, const Plan& plan) {
+    if (!plan.security_patch.empty() && access(security_patch_file, F_OK) == 0) {
+        const int fd = open(security_patch_file, O_WRONLY | O_TRUNC | O_CLOEXEC);
+        if (fd >= 0) {
+            const std::string line = plan.security_patch + "\n";
+            if (write(fd, line.data(), line.size()) != static_cast<ssize_t>(line.size())) {
+                ERROR_LOG("Failed to write: %s", security_patch_file);
+            }
+            close(fd);
+        }
+    }
+    if (plan.changes.empty()) return true;
+
+    std::string batch;
+    for (const Change& c : plan.changes) batch += c.name + "=" + c.value + "\n";
+    const bool batched = io::replaceFile(props_batch_file, batch.data(), batch.size()) &&
+                         run(resetprop, {"-n", "-f", props_batch_file});
+    unlink(props_batch_file);
+    if (batched) return true;
+
+    // A resetprop without -f: one process per prop, as before, but still only the changes.
+    bool ok = true;
+    for (const Change& c : plan.changes) {
+        if (!run(resetprop, {"-n", c.name.c_str(), c.value.c_str()})) {
+            ERROR_LOG("resetprop failed: %s", c.name.c_str());
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+bool upToDate() {
+    io::MappedFile file;
+    if (!file.open(props_state_file)) return false;
+    std::string_view text(file.data(), file.size());
+    auto line = [&text] {
+        const size_t nl = text.find('\n');
+        const std::string_view l = text.substr(0, nl);
+        text = nl == std::string_view::npos ? std::string_view() : text.substr(nl + 1);
+        return l;
+    };
+    char header[128];
+    snprintf(header, sizeof(header), "boot %s inputs %016llx", io::bootId(),
+             static_cast<unsigned long long>(inputsHash()));
+    if (line() != kStateMagic || line() != header) return false;
+    while (!text.empty()) {
+        // <16 hex digits> <name>
+        const std::string_view l = line();
+        uint64_t hash = 0;
+        const auto [last, ec] = std::from_chars(l.data(), l.data() + l.size(), hash, 16);
+        if (ec != std::errc() || last != l.data() + 16 || l.size() < 18 || l[16] != ' ') return false;
+        if (valueHash(current(std::string(l.substr(17)))) != hash) return false;
+    }
+    return true;
+}
+
+void record(const Plan& plan) {
+    char line[128];
+    snprintf(line, sizeof(line), "%s\nboot %s inputs %016llx\n", kStateMagic, io::bootId(),
+             static_cast<unsigned long long>(inputsHash()));
+    std::string text = line;
+    for (const std::vector<Change>* list : {&plan.changes, &plan.held}) {
+        for (const Change& c : *list) {
+            snprintf(line, sizeof(line), "%016llx ", static_cast<unsigned long long>(valueHash(c.value)));
+            text += line;
+            text += c.name + "\n";
+        }
+    }
+    if (!io::replaceFile(props_state_file, text.data(), text.size())) forget();
+}
+
+void forget() {
+    unlink(props_state_file);
+}
+
+} // namespace props
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "phash.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// The system properties side of the spoof: which props each config key rewrites, and the one
+// pass that works out what actually has to change. service.sh used to do this with a grep and
+// a sed per prop and a resetprop per change; copgvd does it in one process.
+static constexpr const char* skip_resetprop_file = "/data/adb/modules/COPG-VD/.skip.resetprop";
+static constexpr const char* skip_manufacturer_file = "/data/adb/modules/COPG-VD/.skip.manufacturer";
+static constexpr const char* security_patch_file = "/data/adb/tricky_store/security_patch.txt";
+// Handed to `resetprop -f`, then removed.
+static constexpr const char* props_batch_file = "/data/adb/modules/COPG-VD/.props.batch";
+// What the last apply left in place, and from which inputs, in this boot. See upToDate().
+static constexpr const char* props_state_file = "/data/adb/modules/COPG-VD/.props.applied";
+
+namespace props {
+
+// See props.def.
+enum class Rule : uint8_t { Copy, Version, Fixed, Optional };
+
+struct Mapping {
+    const char* key;
+    Rule rule;
+    std::string_view props;     // '|'-separated
+};
+
+static constexpr Mapping kMappings[] = {
+#define PROP_MAP(key, rule, props) {#key, Rule::rule, props},
+#define PROP_GROUP(name, props)
+#include "props.def"
+#undef PROP_MAP
+#undef PROP_GROUP
+};
+static constexpr size_t kMappingCount = std::size(kMappings);
+
+enum Group : size_t {
+#define PROP_MAP(key, rule, props)
+#define PROP_GROUP(name, props) G_##name,
+#include "props.def"
+#undef PROP_MAP
+#undef PROP_GROUP
+    G_COUNT
+};
+
+static constexpr std::string_view kGroups[] = {
+#define PROP_MAP(key, rule, props)
+#define PROP_GROUP(name, props) props,
+#include "props.def"
+#undef PROP_MAP
+#undef PROP_GROUP
+};
+
+// Calls f(name) for each prop of a '|'-separated list.
+template <typename F>
+constexpr void forEachProp(std::string_view list, F&& f) {
+    while (!list.empty()) {
+        const size_t bar = list.find('|');
+        f(list.substr(0, bar));
+        list = bar == std::string_view::npos ? std::string_view() : list.substr(bar + 1);
+    }
+}
+
+constexpr size_t propCount() {
+    size_t n = 0;
+    for (const Mapping& m : kMappings) forEachProp(m.props, [&n](std::string_view) { n++; });
+    for (std::string_view g : kGroups) forEachProp(g, [&n](std::string_view) { n++; });
+    return n;
+}
+static constexpr size_t kPropCount = propCount();
+
+// Every prop named above, rows first and then groups, repeats included.
+constexpr std::array<std::string_view, kPropCount> propNames() {
+    std::array<std::string_view, kPropCount> names{};
+    size_t n = 0;
+    auto add = [&names, &n](std::string_view name) { names[n++] = name; };
+    for (const Mapping& m : kMappings) forEachProp(m.props, add);
+    for (std::string_view g : kGroups) forEachProp(g, add);
+    return names;
+}
+static constexpr std::array<std::string_view, kPropCount> kPropNames = propNames();
+static constexpr phash::Table<kPropCount> kPropIndex(kPropNames);
+
+// A prop's index in kPropNames - its first one, when it is listed more than once -
+// or kPropCount when the table does not name it.
+constexpr size_t propId(std::string_view name) { return kPropIndex.find(name); }
+
+struct Change {
+    std::string name;
+    std::string value;
+};
+
+struct Plan {
+    std::vector<Change> changes;    // props that exist and hold something else, in config order
+    std::vector<Change> held;       // props that exist and already hold what the config asks
+    std::string security_patch;     // for TrickyStore, when the config has one
+};
+
+// Reads the config, the version policy, the ROM and the props the mapping names, and lists
+// what differs. Props that do not exist are never created. The profile is the default one -
+// see defaultProfile() - or the profiles_object entry `profile` names. false when the config
+// cannot be read, the profile is not in it, or there is no property area to compare against;
+// the reason is logged.
+bool plan(const char* config, Plan& out, std::string_view profile = {});
+
+// Writes the plan with one `resetprop -n -f`, and prop by prop only if that is refused.
+// false when any prop could not be set.
+bool apply(const char* resetprop, const Plan& plan);
+
+// props_state_file records the boot, the stamps of every input and a hash of each prop's
+// value after an apply. true when it is from this boot and these inputs and every prop still
+// holds its value: then there is nothing to do, and the config need not even be parsed.
+// A reboot always means a full pass - resetprop -n does not outlive it.
+bool upToDate();
+
+// Records a plan that apply() wrote in full. Any earlier record is dropped otherwise.
+void record(const Plan& plan);
+void forget();
+
+} // namespace props
@@ -1,355 +1,179 @@
+#include <cstdint>
 #include <jni.h>
-#include <string>
+#include <sys/types.h>
 #include <zygisk.hpp>
-#include <json.hpp>
-#include <fstream>
-#include <android/log.h>
-#include <algorithm>
-#include <cctype>
-
-using json = nlohmann::json;
-
-#define LOG_TAG "COPG-VD"
-#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
-#define ERROR_LOG(...) LOGE("[ERROR] " __VA_ARGS__)
-
-static const std::string config_file = "/data/adb/COPG-VD.json";
-// What the ROM really is. NEVER a system property: the module rewrites those very props, so
-// asking the system would be asking our own lie. /build.prop does not exist on these devices;
-// on a custom ROM the fingerprint line inside this file is stale, but ro.build.version.* is good.
-static const std::string rom_prop_file = "/system/build.prop";
-static const std::string version_policy_file = "/data/adb/modules/COPG-VD/.spoof.version";
-
-// The Android version belongs to the ROM, not to the build being spoofed. An app told the SDK
-// is newer than the framework really is calls APIs that do not exist: Google's apps crash, the
-// device reboots, and it repeats - a softloop, which leaves nothing in the boot logs.
-//   Never = the version group is never applied (default)
-//   Rom   = only what does not exceed the ROM (in practice, lowering the SDK)
-//   Force = whatever the config says
-enum class VersionPolicy { Never, Rom, Force };
-
-struct RomVersion {
-    std::string release;
-    std::string codename;
-    int sdk = 0;
-};
-
-struct DeviceInfo {
-    std::string brand;
-    std::string device;
-    std::string manufacturer;
-    std::string model;
-    std::string fingerprint;
-    std::string product;
-    std::string android_version;
-    int version_sdk_int = 0;
-    std::string board;
-    std::string bootloader;
-    std::string hardware;
-    std::string id;
-    std::string display;
-    std::string host;
-    std::string odm_sku;
-    std::string sku;
-    std::string user;
-    int64_t time = 0;
-    std::string version_incremental;
-    std::string version_sdk;
-    int version_sdk_int_full = 0;
-    std::string version_security_patch;
-    std::string version_release_or_codename;
-    std::string version_release_or_preview_display;
-    std::string version_codename;
-};
-
-static inline std::string trim(const std::string& str) {
-    auto start = std::find_if_not(str.begin(), str.end(), [](unsigned char c) { 
-        return std::isspace(c); 
-    });
-    auto end = std::find_if_not(str.rbegin(), str.rend(), [](unsigned char c) { 
-        return std::isspace(c); 
-    }).base();
-    return (start < end) ? std::string(start, end) : std::string();
-}
-
-static RomVersion readRomVersion() {
-    RomVersion rom;
-    std::ifstream file(rom_prop_file);
-    if (!file.is_open()) return rom;                 // unknown ROM -> nothing is allowed through
-    std::string line;
-    while (std::getline(file, line)) {
-        auto take = [&line](const char* key, std::string& out) {
-            const std::string needle = std::string(key) + "=";
-            if (line.rfind(needle, 0) == 0) out = trim(line.substr(needle.size()));
-        };
-        take("ro.build.version.release", rom.release);
-        take("ro.build.version.codename", rom.codename);
-        std::string sdk;
-        take("ro.build.version.sdk", sdk);
-        if (!sdk.empty()) {
-            try { rom.sdk = std::stoi(sdk); } catch (const std::exception&) { rom.sdk = 0; }
-        }
-    }
-    return rom;
-}
-
-static VersionPolicy readVersionPolicy() {
-    std::ifstream file(version_policy_file);
-    if (!file.is_open()) return VersionPolicy::Never;
-    std::string value;
-    std::getline(file, value);
-    value = trim(value);
-    if (value == "force") return VersionPolicy::Force;
-    if (value == "rom") return VersionPolicy::Rom;
-    return VersionPolicy::Never;
-}
-
-// AOSP: RELEASE_OR_CODENAME = "REL".equals(CODENAME) ? RELEASE : CODENAME. Copying CODENAME
-// into it publishes the literal string "REL" where the version number belongs, which is a
-// combination no real device reports.
-static std::string releaseOrCodename(const std::string& codename, const std::string& release) {
-    return (codename.empty() || codename == "REL") ? release : codename;
-}
+#include "log.hpp"
+#include "profile.hpp"
+#include "image.hpp"
+#include "companion.hpp"
+#include "prophook.hpp"
+#include "stats.hpp"
+#include "trace.hpp"
+#include <vector>
+#include <unistd.h>
 
 class COPGVDModule : public zygisk::ModuleBase {
 private:
     zygisk::Api* api = nullptr;
     JNIEnv* env = nullptr;
 
-    // Value-initialized: setInt/setLong only skip a field when it is 0, so an
-    // indeterminate int here would be written straight into Build.TIME.
+    // Value-initialized: a number is only left alone when it is 0, so an indeterminate
+    // one here would be written straight into Build.TIME.
     DeviceInfo spoof_info{};
 
-    void spoofDevice() {
-        jclass buildClass = env->FindClass("android/os/Build");
-        if (!buildClass) {
-            env->ExceptionClear();
-            return;
+    // `process` picks the profile; nullptr, or a process nobody mapped, gets "COPG-VD".
+    // true when props were hooked: the library must then stay loaded.
+    bool spoofDevice(const char* process, bool hook) {
+        trace::start();
+        bool hooked;
+        {
+            trace::Scope slice("spoof");
+            hooked = resolveAndApply(process, hook);
         }
+        trace::stop();
+        return hooked;
+    }
 
-        auto getField = [this](jclass cls, const char* name, const char* sig) -> jfieldID {
-            jfieldID id = env->GetStaticFieldID(cls, name, sig);
-            if (env->ExceptionCheck()) env->ExceptionClear();
-            return id;
-        };
-
-        jfieldID build_modelField = getField(buildClass, "MODEL", "Ljava/lang/String;");
-        jfieldID build_brandField = getField(buildClass, "BRAND", "Ljava/lang/String;");
-        jfieldID build_deviceField = getField(buildClass, "DEVICE", "Ljava/lang/String;");
-        jfieldID build_manufacturerField = getField(buildClass, "MANUFACTURER", "Ljava/lang/String;");
-        jfieldID build_fingerprintField = getField(buildClass, "FINGERPRINT", "Ljava/lang/String;");
-        jfieldID build_productField = getField(buildClass, "PRODUCT", "Ljava/lang/String;");
-        jfieldID build_boardField = getField(buildClass, "BOARD", "Ljava/lang/String;");
-        jfieldID build_bootloaderField = getField(buildClass, "BOOTLOADER", "Ljava/lang/String;");
-        jfieldID build_hardwareField = getField(buildClass, "HARDWARE", "Ljava/lang/String;");
-        jfieldID build_idField = getField(buildClass, "ID", "Ljava/lang/String;");
-        jfieldID build_displayField = getField(buildClass, "DISPLAY", "Ljava/lang/String;");
-        jfieldID build_hostField = getField(buildClass, "HOST", "Ljava/lang/String;");
-        jfieldID build_odm_skuField = getField(buildClass, "ODM_SKU", "Ljava/lang/String;");
-        jfieldID build_skuField = getField(buildClass, "SKU", "Ljava/lang/String;");
-        jfieldID build_tagsField = getField(buildClass, "TAGS", "Ljava/lang/String;");
-        jfieldID build_timeField = getField(buildClass, "TIME", "J");
-        jfieldID build_typeField = getField(buildClass, "TYPE", "Ljava/lang/String;");
-        jfieldID build_userField = getField(buildClass, "USER", "Ljava/lang/String;");
-
-        jclass versionClass = env->FindClass("android/os/Build$VERSION");
-        jfieldID build_version_releaseField = nullptr;
-        jfieldID build_version_sdk_intField = nullptr;
-        jfieldID build_version_codenameField = nullptr;
-        jfieldID build_version_incrementalField = nullptr;
-        jfieldID build_version_sdkField = nullptr;
-        jfieldID build_version_sdk_int_fullField = nullptr;
-        jfieldID build_version_security_patchField = nullptr;
-        jfieldID build_version_release_or_codenameField = nullptr;
-        jfieldID build_version_release_or_preview_displayField = nullptr;
-
-        if (versionClass) {
-            build_version_releaseField = getField(versionClass, "RELEASE", "Ljava/lang/String;");
-            build_version_sdk_intField = getField(versionClass, "SDK_INT", "I");
-            build_version_codenameField = getField(versionClass, "CODENAME", "Ljava/lang/String;");
-            build_version_incrementalField = getField(versionClass, "INCREMENTAL", "Ljava/lang/String;");
-            build_version_sdkField = getField(versionClass, "SDK", "Ljava/lang/String;");
-            build_version_sdk_int_fullField = getField(versionClass, "SDK_INT_FULL", "I");
-            build_version_security_patchField = getField(versionClass, "SECURITY_PATCH", "Ljava/lang/String;");
-            build_version_release_or_codenameField = getField(versionClass, "RELEASE_OR_CODENAME", "Ljava/lang/String;");
-            build_version_release_or_preview_displayField = getField(versionClass, "RELEASE_OR_PREVIEW_DISPLAY", "Ljava/lang/String;");
+    bool resolveAndApply(const char* process, bool hook) {
+        // The compiled image on disk when it is current, the companion's when it is not, the
+        // JSON when neither is there. Either way `view` is what gets applied; in the first two
+        // cases it points straight into the image. The companion is asked for nothing while
+        // the image on disk is current, unless tracing: then it takes the stats.
+        Stats stats;
+        stats.pid = getpid();
+        const uint64_t start = Stats::now();
+        uint64_t t = start;
+
+        image::Mapping img;
+        bool mapped;
+        {
+            trace::Scope slice("image");
+            mapped = img.open(image_file);
         }
-
-        std::ifstream file(config_file);
-        if (!file.is_open()) {
-            ERROR_LOG("Failed to open: %s", config_file.c_str());
-            env->DeleteLocalRef(buildClass);
-            if (versionClass) env->DeleteLocalRef(versionClass);
-            return;
+        stats.lap(PH_OPEN, t);
+        companion::Client client(!mapped || trace::enabled() ? api->connectCompanion() : -1);
+        std::vector<char> blob;
+        const image::Header* header = nullptr;
+        ProfileView view;
+        bool fetched;
+        {
+            // Read even when it goes unused, so the companion is not left writing to a
+            // closed socket.
+            trace::Scope slice("fetch");
+            fetched = client.fetch(blob) && (header = image::check(blob.data(), blob.size()));
         }
-
-        try {
-            json config = json::parse(file);
-
-            if (config.contains(std::string(LOG_TAG)) && config[LOG_TAG].is_object()) {
-                auto device = config[LOG_TAG];
-
-                spoof_info.brand = device.value("BRAND", "");
-                spoof_info.device = device.value("DEVICE", "");
-                spoof_info.manufacturer = device.value("MANUFACTURER", "");
-                spoof_info.model = device.value("MODEL", "");
-                spoof_info.fingerprint = device.value("FINGERPRINT", "");
-                spoof_info.product = device.value("PRODUCT", "");
-                spoof_info.board = device.value("BOARD", "");
-                spoof_info.bootloader = device.value("BOOTLOADER", "");
-                spoof_info.hardware = device.value("HARDWARE", "");
-                spoof_info.id = device.value("ID", "");
-                spoof_info.display = device.value("DISPLAY", "");
-                spoof_info.host = device.value("HOST", "");
-                spoof_info.odm_sku = device.value("ODM_SKU", spoof_info.product);
-                spoof_info.sku = device.value("SKU", spoof_info.hardware);
-                spoof_info.user = device.value("USER", "");
-                spoof_info.version_incremental = device.value("INCREMENTAL", "");
-                spoof_info.version_security_patch = device.value("SECURITY_PATCH", "");
-                if (device.contains("TIMESTAMP")) {
-                    const auto& device_timestamp = device["TIMESTAMP"];
-                    spoof_info.time = std::stoll(device_timestamp.get<std::string>()) * 1000;
-                }
-
-                // --- the version group, and only what the semaphore lets through ---
-                const RomVersion rom = readRomVersion();
-                const VersionPolicy policy = readVersionPolicy();
-                auto allowed = [&rom, policy](const char* field, const std::string& value) {
-                    if (policy == VersionPolicy::Force) return true;
-                    if (policy == VersionPolicy::Never) return false;
-                    // Rom: never above the ROM. Raising the SDK is what makes apps call APIs
-                    // the framework does not have; lowering it only makes them ask for less.
-                    const std::string f(field);
-                    if (f == "SDK_INT" || f == "SDK_FULL") {
-                        if (rom.sdk == 0) return false;
-                        try { return std::stoi(value) <= rom.sdk; }
-                        catch (const std::exception&) { return false; }
-                    }
-                    if (f == "ANDROID_VERSION") return !rom.release.empty() && value == rom.release;
-                    if (f == "CODENAME") return !rom.codename.empty() && value == rom.codename;
-                    return false;
-                };
-
-                const std::string cfg_codename = device.value("CODENAME", "");
-                if (!trim(cfg_codename).empty() && allowed("CODENAME", cfg_codename)) {
-                    spoof_info.version_codename = cfg_codename;
-                }
-
-                if (device.contains("ANDROID_VERSION")) {
-                    const std::string value = device["ANDROID_VERSION"].get<std::string>();
-                    if (allowed("ANDROID_VERSION", value)) spoof_info.android_version = value;
-                }
-
-                if (device.contains("SDK_INT")) {
-                    const std::string value = device["SDK_INT"].get<std::string>();
-                    if (allowed("SDK_INT", value)) {
-                        spoof_info.version_sdk_int = std::stoi(value);
-                        spoof_info.version_sdk = std::to_string(spoof_info.version_sdk_int);
-                    }
-                }
-
-                if (device.contains("SDK_FULL")) {
-                    const std::string value = device["SDK_FULL"].get<std::string>();
-                    if (allowed("SDK_FULL", value)) {
-                        auto dot_position = value.find('.');
-                        int major = std::stoi(dot_position == std::string::npos ? value : value.substr(0, dot_position));
-                        int minor = 0;
-                        if (dot_position != std::string::npos) {
-                            minor = std::stoi(value.substr(dot_position + 1));
-                        }
-                        spoof_info.version_sdk_int_full = major * 100000 + minor;
-                    }
-                }
-                if (!spoof_info.version_sdk_int_full && spoof_info.version_sdk_int) {
-                    spoof_info.version_sdk_int_full = spoof_info.version_sdk_int * 100000;
-                }
-
-                // Derived from what actually got through, by the AOSP rule. Left empty when the
-                // version is not spoofed at all, so the framework keeps its own correct values.
-                if (!spoof_info.version_codename.empty() || !spoof_info.android_version.empty()) {
-                    const std::string cod = spoof_info.version_codename.empty()
-                                          ? rom.codename : spoof_info.version_codename;
-                    const std::string rel = spoof_info.android_version.empty()
-                                          ? rom.release : spoof_info.android_version;
-                    spoof_info.version_release_or_codename = releaseOrCodename(cod, rel);
-                    spoof_info.version_release_or_preview_display = spoof_info.version_release_or_codename;
-                }
+        stats.lap(PH_FETCH, t);
+        if (mapped) {
+            view = img.view(process);
+            stats.source = Source::Image;
+            stats.bytes = static_cast<uint32_t>(img.size());
+        } else if (fetched) {
+            view = image::viewOf(*header, process);
+            stats.source = Source::Companion;
+            stats.bytes = static_cast<uint32_t>(blob.size());
+        } else {
+            const bool loaded = loadProfile(config_file, spoof_info, &stats, nullptr, Selector{{}, process});
+            t = Stats::now();
+            if (!loaded) {
+                stats.total_ns = t - start;
+                client.report(stats);
+                return false;
             }
-        } catch (const std::exception& e) {
-            ERROR_LOG("Config error: %s", e.what());
-            env->DeleteLocalRef(buildClass);
-            if (versionClass) env->DeleteLocalRef(versionClass);
-            return;
+            view = viewOf(spoof_info);
+            stats.source = Source::Json;
         }
+        {
+            trace::Scope slice("apply");
+            apply(view, stats);
+        }
+        // Only from an image: the prop table is planned by copgvd, never here. An excluded
+        // process gets none, and sees the real props as well.
+        const image::Header* compiled = mapped ? img.get() : header;
+        bool hooked = false;
+        if (hook && compiled && stats.fields > 0) {
+            trace::Scope slice("hook");
+            hooked = prophook::install(api, *compiled, process);
+        }
+        stats.total_ns = Stats::now() - start;
+        client.report(stats);
+        return hooked;
+    }
 
-        auto setStr = [this](jclass thisClass, jfieldID field, const std::string& value) {
-            if (!field || trim(value).empty()) return;
-            jstring js = env->NewStringUTF(value.c_str());
-            if (!js || env->ExceptionCheck()) {
-                env->ExceptionClear();
-                return;
+    // One pass over kBuildFields. A class is looked up the first time one of its fields has
+    // something to write, and a fieldID only for a field that does: no value, no JNI call.
+    void apply(const ProfileView& view, Stats& stats) {
+        jclass classes[static_cast<size_t>(Cls::Count)] = {};
+        bool looked_up[static_cast<size_t>(Cls::Count)] = {};
+
+        uint64_t t = Stats::now();
+        for (size_t f = 0; f < kFieldCount; f++) {
+            const BuildField& field = kBuildFields[f];
+            if (field.kind == Kind::Str ? !view.str[f] : view.num[f] == 0) continue;
+
+            const size_t c = static_cast<size_t>(field.cls);
+            if (!looked_up[c]) {
+                looked_up[c] = true;
+                classes[c] = env->FindClass(kClassNames[c]);
+                if (!classes[c]) env->ExceptionClear();
             }
-            env->SetStaticObjectField(thisClass, field, js);
-            env->DeleteLocalRef(js);
-            if (env->ExceptionCheck()) env->ExceptionClear();
-        };
+            if (!classes[c]) continue;
 
-        auto setInt = [this](jclass thisClass, jfieldID field, int value) {
-            if (!field || value == 0) return;
-            env->SetStaticIntField(thisClass, field, value);
+            jfieldID id = env->GetStaticFieldID(classes[c], field.name, field.sig);
             if (env->ExceptionCheck()) env->ExceptionClear();
-        };
-
-        auto setLong = [this](jclass thisClass, jfieldID field, int64_t value) {
-            if (!field || value == 0) return;
-            env->SetStaticLongField(thisClass, field, value);
+            stats.lap(PH_RESOLVE, t);
+            if (!id) continue;
+
+            switch (field.kind) {
+                case Kind::Str: {
+                    jstring js = env->NewStringUTF(view.str[f]);
+                    if (!js || env->ExceptionCheck()) {
+                        env->ExceptionClear();
+                        stats.lap(PH_WRITE, t);
+                        continue;
+                    }
+                    env->SetStaticObjectField(classes[c], id, js);
+                    env->DeleteLocalRef(js);
+                    break;
+                }
+                case Kind::Int:
+                    env->SetStaticIntField(classes[c], id, static_cast<jint>(view.num[f]));
+                    break;
+                case Kind::Long:
+                    env->SetStaticLongField(classes[c], id, view.num[f]);
+                    break;
+            }
             if (env->ExceptionCheck()) env->ExceptionClear();
-        };
-
-        setStr(buildClass, build_modelField, spoof_info.model);
-        setStr(buildClass, build_brandField, spoof_info.brand);
-        setStr(buildClass, build_deviceField, spoof_info.device);
-        setStr(buildClass, build_manufacturerField, spoof_info.manufacturer);
-        setStr(buildClass, build_fingerprintField, spoof_info.fingerprint);
-        setStr(buildClass, build_productField, spoof_info.product);
-        setStr(buildClass, build_boardField, spoof_info.board);
-        setStr(buildClass, build_bootloaderField, spoof_info.bootloader);
-        setStr(buildClass, build_hardwareField, spoof_info.hardware);
-        setStr(buildClass, build_idField, spoof_info.id);
-        setStr(buildClass, build_displayField, spoof_info.display);
-        setStr(buildClass, build_hostField, spoof_info.host);
-        setStr(buildClass, build_odm_skuField, spoof_info.odm_sku);
-        setStr(buildClass, build_skuField, spoof_info.sku);
-        setStr(buildClass, build_userField, spoof_info.user);
-        setLong(buildClass, build_timeField, spoof_info.time);
-        setStr(buildClass, build_tagsField, "release-keys");
-        setStr(buildClass, build_typeField, "user");
-
-        if (versionClass) {
-            setStr(versionClass, build_version_codenameField, spoof_info.version_codename);
-            setStr(versionClass, build_version_incrementalField, spoof_info.version_incremental);
-            setStr(versionClass, build_version_sdkField, spoof_info.version_sdk);
-            setInt(versionClass, build_version_sdk_int_fullField, spoof_info.version_sdk_int_full);
-            setStr(versionClass, build_version_security_patchField, spoof_info.version_security_patch);
-            setStr(versionClass, build_version_releaseField, spoof_info.android_version);
-            setInt(versionClass, build_version_sdk_intField, spoof_info.version_sdk_int);
-            setStr(versionClass, build_version_release_or_codenameField, spoof_info.version_release_or_codename);
-            setStr(versionClass, build_version_release_or_preview_displayField, spoof_info.version_release_or_preview_display);
+            else stats.fields++;
+            stats.lap(PH_WRITE, t);
         }
 
-        env->DeleteLocalRef(buildClass);
-        if (versionClass) env->DeleteLocalRef(versionClass);
+        for (jclass cls : classes) {
+            if (cls) env->DeleteLocalRef(cls);
+        }
     }
 
 public:
     void onLoad(zygisk::Api* api, JNIEnv* env) override {
         this->api = api;
         this->env = env;
+    }
 
-        spoofDevice();
+    // Not onLoad: the companion can only be reached from pre*Specialize. Both still run in
+    // the fresh child, before anything of the app or system_server reads Build.
+    void preAppSpecialize(zygisk::AppSpecializeArgs* args) override {
+        // The process name, not the app's package: "com.app:remote" can have its own entry.
+        const char* process = args->nice_name ? env->GetStringUTFChars(args->nice_name, nullptr) : nullptr;
+        const bool hooked = spoofDevice(process, true);
+        if (process) env->ReleaseStringUTFChars(args->nice_name, process);
+        if (!hooked) api->setOption(zygisk::DLCLOSE_MODULE_LIBRARY);
+    }
 
+    // system_server keeps the props resetprop left: what it reads it also records.
+    void preServerSpecialize(zygisk::ServerSpecializeArgs*) override {
+        spoofDevice(nullptr, false);
         api->setOption(zygisk::DLCLOSE_MODULE_LIBRARY);
     }
 };
 
 REGISTER_ZYGISK_MODULE(COPGVDModule)
+REGISTER_ZYGISK_COMPANION(companion::serve)
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <time.h>
+
+// What the spoof cost one process, phase by phase. The module fills it in and hands it to
+// the companion when the companion asks for it; the companion - the only side allowed to
+// write under /data/adb - appends it to stats_file, one line per process it asked:
+//
+//   boot_id pid abi source total fetch open parse rom policy resolve write bytes fields
+//
+// tab-separated, times in nanoseconds. The WebUI shows the latest line and the median.
+// stats_dir is a directory of its own so that writing it is no event for the companion's
+// inotify watch on the module directory.
+static constexpr const char* stats_dir = "/data/adb/modules/COPG-VD/.cost";
+static constexpr const char* stats_file = "/data/adb/modules/COPG-VD/.cost/stats";
+
+#if defined(__aarch64__)
+#define COPGVD_ABI "arm64-v8a"
+#elif defined(__arm__)
+#define COPGVD_ABI "armeabi-v7a"
+#elif defined(__x86_64__)
+#define COPGVD_ABI "x86_64"
+#elif defined(__i386__)
+#define COPGVD_ABI "x86"
+#else
+#define COPGVD_ABI "unknown"
+#endif
+
+enum Phase : uint8_t {
+    PH_FETCH,       // asking the companion
+    PH_OPEN,        // opening and checking the image, or opening and reading the JSON
+    PH_PARSE,       // the JSON's SAX pass and the version policy
+    PH_ROM,         // readRomVersion()
+    PH_POLICY,      // readVersionPolicy()
+    PH_RESOLVE,     // FindClass and GetStaticFieldID
+    PH_WRITE,       // NewStringUTF and SetStatic*Field
+    PH_COUNT
+};
+
+enum class Source : uint8_t { None, Companion, Image, Json };
+
+// Sent as it is: module and companion are always the same ABI.
+struct Stats {
+    uint64_t ns[PH_COUNT] = {};
+    uint64_t total_ns = 0;
+    int32_t pid = 0;
+    uint32_t bytes = 0;             // of the image or the JSON that was applied
+    uint16_t fields = 0;            // Build fields written
+    Source source = Source::None;
+
+    static uint64_t now() {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000u + static_cast<uint64_t>(ts.tv_nsec);
+    }
+
+    // Charges the time since `since` to `phase` and moves `since` up to now.
+    void lap(Phase phase, uint64_t& since) {
+        const uint64_t t = now();
+        ns[phase] += t - since;
+        since = t;
+    }
+};
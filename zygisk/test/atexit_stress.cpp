@@ -0,0 +1,207 @@
+// The atexit shim, compiled in under names of its own so that it sees only what the test
+// registers - not the C++ runtime's handlers, nor the test's own exit. Registrations from
+// many threads at once, across dsos, with finalizes running alongside them. Every handler
+// must run exactly once, and a finalize with no registration racing it must run its dso's
+// entries newest first - the inline slots and the overflow together. Each round prints the
+// registration throughput and the latency of a single __cxa_atexit, p50, p99 and max. Meant
+// for -DSANITIZE=thread and address builds as much as for the plain one.
+//
+//   atexit_stress [ROUNDS]
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <time.h>
+#include <vector>
+
+#define __cxa_atexit shim_atexit
+#define __cxa_finalize shim_finalize
+#include "atexit.cpp"
+
+namespace {
+
+constexpr int kThreads = 8;
+constexpr int kPerThread = 200;             // past the 32 inline slots on every round
+constexpr int kDsos = 3;                    // 0 and 1 finalized once quiet, 2 all along
+
+// Stand-ins for __dso_handle: only their addresses matter.
+char dsos[kDsos];
+constexpr size_t kMaxEntries = size_t{kThreads} * kPerThread;
+
+struct Entry {
+    int thread;
+    int seq;                                // per thread, in registration order
+    int dso;
+};
+
+Entry entries[kMaxEntries];
+size_t entry_count = 0;
+std::atomic<int> ran[kMaxEntries];          // times each entry's handler ran
+int order[kMaxEntries * 2];                 // entry indexes, in the order they ran
+std::atomic<size_t> order_len{0};
+std::atomic<int> failures{0};
+
+// The latency of every registration of a round, one run per thread.
+uint64_t latency_ns[kMaxEntries];
+
+uint64_t now() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+void fail(const std::string& what) {
+    std::fprintf(stderr, "FAIL %s\n", what.c_str());
+    failures++;
+}
+
+void handler(void* arg) {
+    const size_t index = static_cast<size_t>(static_cast<Entry*>(arg) - entries);
+    ran[index].fetch_add(1, std::memory_order_relaxed);
+    order[order_len.fetch_add(1, std::memory_order_relaxed)] = static_cast<int>(index);
+}
+
+void reset(size_t count) {
+    entry_count = count;
+    for (size_t i = 0; i < count; i++) {
+        entries[i] = Entry{};
+        ran[i] = 0;
+    }
+    order_len = 0;
+}
+
+// What ran since `from`: only `dso`'s entries, and each thread's newest first.
+void expectNewestFirst(size_t from, int dso, const char* what) {
+    std::vector<int> last(kThreads, kPerThread);
+    for (size_t i = from; i < order_len; i++) {
+        const Entry& e = entries[order[i]];
+        if (e.dso != dso) fail(std::string(what) + ": ran an entry of another dso");
+        if (e.seq >= last[e.thread]) fail(std::string(what) + ": thread " + std::to_string(e.thread) + " out of order");
+        last[e.thread] = e.seq;
+    }
+}
+
+void expectAllRanOnce(const char* what) {
+    for (size_t i = 0; i < entry_count; i++) {
+        if (ran[i] != 1) {
+            fail(std::string(what) + ": entry " + std::to_string(i) + " ran " + std::to_string(ran[i].load()) + " times");
+            return;
+        }
+    }
+}
+
+// Threads register for all three dsos while another finalizes dso 2 over and over; then
+// dsos 0 and 1 are finalized with nothing racing them, and what is left of dso 2.
+void concurrentRound(int round) {
+    reset(kMaxEntries);
+    std::atomic<bool> done{false};
+    std::thread finalizer([&done] {
+        while (!done.load(std::memory_order_acquire)) __cxa_finalize(&dsos[2]);
+    });
+    std::vector<std::thread> threads;
+    const uint64_t start = now();
+    for (int t = 0; t < kThreads; t++) {
+        threads.emplace_back([t, round] {
+            for (int i = 0; i < kPerThread; i++) {
+                const size_t n = static_cast<size_t>(t) * kPerThread + i;
+                Entry& e = entries[n];
+                e = Entry{t, i, (t + i + round) % kDsos};
+                const uint64_t before = now();
+                if (__cxa_atexit(handler, &e, &dsos[e.dso]) != 0) fail("registration refused");
+                latency_ns[n] = now() - before;
+            }
+        });
+    }
+    for (std::thread& t : threads) t.join();
+    const uint64_t elapsed = now() - start;
+    done.store(true, std::memory_order_release);
+    finalizer.join();
+
+    std::sort(latency_ns, latency_ns + kMaxEntries);
+    std::printf("round %d: %.0f registrations/s, p50 %llu ns, p99 %llu ns, max %llu ns\n", round,
+                kMaxEntries * 1e9 / (elapsed ? elapsed : 1), static_cast<unsigned long long>(latency_ns[kMaxEntries / 2]),
+                static_cast<unsigned long long>(latency_ns[kMaxEntries * 99 / 100]),
+                static_cast<unsigned long long>(latency_ns[kMaxEntries - 1]));
+
+    const std::string name = "round " + std::to_string(round);
+    for (int dso = 0; dso < 2; dso++) {
+        const size_t from = order_len;
+        __cxa_finalize(&dsos[dso]);
+        expectNewestFirst(from, dso, (name + ", dso " + std::to_string(dso)).c_str());
+    }
+    __cxa_finalize(&dsos[2]);
+    expectAllRanOnce(name.c_str());
+}
+
+// Fills the inline slots for dso 0 and spills into the overflow for dso 1, drains dso 0,
+// then registers for dso 1 again: that entry is the newest and must run first.
+void inlineAfterOverflow() {
+    reset(42);
+    int n = 0;
+    auto add = [&n](int dso) {
+        Entry& e = entries[n];
+        e = Entry{0, n++, dso};
+        __cxa_atexit(handler, &e, &dsos[dso]);
+    };
+    for (int i = 0; i < 40; i++) add(i < 32 ? 0 : 1);
+    __cxa_finalize(&dsos[0]);
+    add(1);
+    add(1);
+    const size_t from = order_len;
+    __cxa_finalize(&dsos[1]);
+    expectNewestFirst(from, 1, "inline after overflow");
+    expectAllRanOnce("inline after overflow");
+}
+
+// A handler that registers another, for its own dso, and one that finalizes its own dso.
+Entry* nested_entry;
+
+void registering(void*) {
+    handler(&entries[0]);
+    __cxa_atexit(handler, nested_entry, &dsos[0]);
+}
+
+void recursing(void*) {
+    handler(&entries[2]);
+    __cxa_finalize(&dsos[0]);
+}
+
+void nested() {
+    reset(4);
+    entries[0] = Entry{0, 0, 0};
+    entries[1] = Entry{0, 1, 0};
+    entries[2] = Entry{0, 2, 0};
+    entries[3] = Entry{0, 3, 0};
+    nested_entry = &entries[1];
+    __cxa_atexit(handler, &entries[3], &dsos[0]);
+    __cxa_atexit(recursing, nullptr, &dsos[0]);
+    __cxa_atexit(registering, nullptr, &dsos[0]);
+    __cxa_finalize(&dsos[0]);
+    // registering, what it registered, recursing, and what recursing's finalize drained.
+    const int expected[] = {0, 1, 2, 3};
+    for (size_t i = 0; i < 4; i++) {
+        if (order[i] != expected[i]) fail("nested: ran out of order");
+    }
+    expectAllRanOnce("nested");
+    __cxa_finalize(&dsos[0]);
+    if (order_len != 4) fail("nested: a handler ran twice");
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const int rounds = argc > 1 ? std::max(1, std::atoi(argv[1])) : 50;
+    nested();
+    inlineAfterOverflow();
+    for (int round = 0; round < rounds; round++) concurrentRound(round);
+    if (failures) {
+        std::fprintf(stderr, "%d checks failed\n", failures.load());
+        return 1;
+    }
+    std::printf("%d rounds of %d threads x %d registrations: ok\n", rounds, kThreads, kPerThread);
+    return 0;
+}
@@ -0,0 +1,168 @@
+#pragma once
+
+// What the host benchmarks share: a heap allocation counter, timing, and the synthetic inputs
+// they write for themselves. Included by exactly one file of each test executable - it
+// defines malloc for the whole program.
+//
+// Every malloc, calloc and realloc of a thread while `counting` is set is counted, bytes
+// included: operator new comes down to malloc as well. On glibc without sanitizers only;
+// kCountsAllocations says whether the numbers mean anything.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__) && !defined(__SANITIZE_THREAD__)
+#define COUNT_ALLOCATIONS 1
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* p, size_t size);
+#endif
+
+namespace bench {
+
+#ifdef COUNT_ALLOCATIONS
+constexpr bool kCountsAllocations = true;
+#else
+constexpr bool kCountsAllocations = false;
+#endif
+
+inline thread_local bool counting = false;
+inline size_t allocations = 0;
+inline size_t allocated_bytes = 0;
+
+inline void count(size_t size) {
+    if (!counting) return;
+    allocations++;
+    allocated_bytes += size;
+}
+
+// For bookkeeping that is not the code being measured.
+class Uncounted {
+public:
+    Uncounted() : was(counting) { counting = false; }
+    ~Uncounted() { counting = was; }
+
+private:
+    const bool was;
+};
+
+// The allocations of `f`, run once on this thread.
+struct Heap {
+    size_t allocations;
+    size_t bytes;
+};
+
+template <typename F>
+Heap heapOf(F&& f) {
+    allocations = 0;
+    allocated_bytes = 0;
+    counting = true;
+    f();
+    counting = false;
+    return {allocations, allocated_bytes};
+}
+
+// "n/a" where allocations are not counted.
+inline std::string heapText(const Heap& heap) {
+    if (!kCountsAllocations) return "n/a allocations";
+    return std::to_string(heap.allocations) + " allocations / " + std::to_string(heap.bytes) + " B";
+}
+
+inline uint64_t now() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+struct Timing {
+    double median_us;
+    double p90_us;
+};
+
+// `f` run `rounds` times, each timed on its own.
+template <typename F>
+Timing timeOf(int rounds, F&& f) {
+    std::vector<uint64_t> ns;
+    ns.reserve(static_cast<size_t>(rounds));
+    for (int i = 0; i < rounds; i++) {
+        const uint64_t start = now();
+        f();
+        ns.push_back(now() - start);
+    }
+    std::sort(ns.begin(), ns.end());
+    return {ns[ns.size() / 2] / 1e3, ns[ns.size() * 9 / 10] / 1e3};
+}
+
+// A file holding `contents` under $TMPDIR, removed on destruction.
+class TempFile {
+public:
+    explicit TempFile(const std::string& contents) {
+        const char* dir = getenv("TMPDIR");
+        path = std::string(dir && *dir ? dir : "/tmp") + "/copgvd-bench-XXXXXX";
+        const int fd = mkstemp(path.data());
+        if (fd < 0 || write(fd, contents.data(), contents.size()) != static_cast<ssize_t>(contents.size())) {
+            std::fprintf(stderr, "cannot write %s\n", path.c_str());
+            std::exit(1);
+        }
+        close(fd);
+    }
+    TempFile(const TempFile&) = delete;
+    TempFile& operator=(const TempFile&) = delete;
+    ~TempFile() { unlink(path.c_str()); }
+
+    const char* c_str() const { return path.c_str(); }
+
+private:
+    std::string path;
+};
+
+// The shipped example's profile, about 730 bytes: what the config benchmarks are made of.
+inline std::string exampleProfile(const std::string& model = "Pixel 9 Pro Fold") {
+    return "{\n"
+           "    \"BRAND\": \"google\",\n"
+           "    \"DEVICE\": \"comet\",\n"
+           "    \"MANUFACTURER\": \"Google\",\n"
+           "    \"MODEL\": \"" + model + "\",\n"
+           "    \"FINGERPRINT\": \"google/comet_beta/comet:CANARY/ZP11.260717.006/16004061:user/release-keys\",\n"
+           "    \"PRODUCT\": \"comet_beta\",\n"
+           "    \"BOOTLOADER\": \"unknown\",\n"
+           "    \"BOARD\": \"comet\",\n"
+           "    \"HARDWARE\": \"comet\",\n"
+           "    \"DISPLAY\": \"ZP11.260717.006\",\n"
+           "    \"ID\": \"ZP11.260717.006\",\n"
+           "    \"HOST\": \"e6a08b72aae6\",\n"
+           "    \"INCREMENTAL\": \"16004061\",\n"
+           "    \"TIMESTAMP\": \"1785780531\",\n"
+           "    \"PREVIEW_SDK\": \"20260805\",\n"
+           "    \"USER\": \"android-build\",\n"
+           "    \"SDK_FINGERPRINT\": \"88d3b71bccd150fc3f60ac4d1026e1db\",\n"
+           "    \"UUID\": \"62diQFW6nD4Hahmxok7HCfvYo9s1e42GqP9SatyVrVQ\",\n"
+           "    \"SECURITY_PATCH\": \"2026-08-05\"\n"
+           "  }";
+}
+
+} // namespace bench
+
+#ifdef COUNT_ALLOCATIONS
+extern "C" void* malloc(size_t size) {
+    bench::count(size);
+    return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size) {
+    bench::count(count * size);
+    return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* p, size_t size) {
+    bench::count(size);
+    return __libc_realloc(p, size);
+}
+#endif
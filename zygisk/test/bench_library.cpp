@@ -0,0 +1,95 @@
+// Load cost against library size: configs of 1 to 1000 profiles, each a copy of the shipped
+// example's, read for a process on "COPG-VD" and for one mapped to the last profile. Three
+// ways: a DOM of the whole document, as before the outline; loadProfile(), which steps over
+// the library; and the compiled image, opened and viewed as zygote does. Median and p90 of
+// ROUNDS loads.
+//
+//   bench_library [ROUNDS]
+
+#include "bench.hpp"
+#include "image.hpp"
+#include "io.hpp"
+#include "log.hpp"
+#include "profile.hpp"
+#include <json.hpp>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace {
+
+using json = nlohmann::json;
+
+constexpr const char* kMapped = "com.example.mapped";
+
+std::string library(int profiles) {
+    std::string text = "{\n  \"" + std::string(LOG_TAG) + "\": " + bench::exampleProfile() + ",\n  \"" +
+                       profiles_object + "\": {\n";
+    for (int i = 0; i < profiles; i++) {
+        text += "    \"dev" + std::to_string(i) + "\": " + bench::exampleProfile("Device " + std::to_string(i));
+        text += i + 1 < profiles ? ",\n" : "\n";
+    }
+    text += "  },\n  \"" + std::string(packages_object) + "\": {\"" + kMapped + "\": \"dev" +
+            std::to_string(profiles - 1) + "\"}\n}\n";
+    return text;
+}
+
+// The whole document parsed, then the process's profile looked up in it.
+bool domLoad(const char* path, bool mapped) {
+    io::MappedFile file;
+    if (!file.open(path)) return false;
+    const json doc = json::parse(file.data(), file.data() + file.size(), nullptr, false);
+    if (doc.is_discarded()) return false;
+    const json* profile = &doc[LOG_TAG];
+    if (mapped) {
+        const std::string name = doc[packages_object][kMapped].get<std::string>();
+        profile = &doc[profiles_object][name];
+    }
+    return profile->is_object() && profile->contains("MODEL");
+}
+
+bool outlineLoad(const char* path, bool mapped) {
+    DeviceInfo info{};
+    return loadProfile(path, info, nullptr, nullptr, Selector{{}, mapped ? kMapped : nullptr}) &&
+           viewOf(info).str[0] != nullptr;
+}
+
+bool imageLoad(const char* path, const char* config, bool mapped) {
+    image::Mapping img;
+    return img.open(path, config) && img.view(mapped ? kMapped : nullptr).str[0] != nullptr;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const int rounds = argc > 1 ? std::max(1, std::atoi(argv[1])) : 200;
+    int failures = 0;
+    std::printf("one load, %d rounds, median / p90 in us: default process | mapped process\n", rounds);
+    for (const int profiles : {1, 10, 100, 1000}) {
+        const std::string text = library(profiles);
+        const bench::TempFile config(text);
+        std::vector<char> bytes;
+        if (!image::build(config.c_str(), bytes)) {
+            std::fprintf(stderr, "FAIL %d profiles: no image\n", profiles);
+            return 1;
+        }
+        const bench::TempFile compiled(std::string(bytes.begin(), bytes.end()));
+        std::printf("%4d profiles, %6.1f KB, image %.1f KB\n", profiles, text.size() / 1024.0, bytes.size() / 1024.0);
+        for (const bool mapped : {false, true}) {
+            if (!domLoad(config.c_str(), mapped) || !outlineLoad(config.c_str(), mapped) ||
+                !imageLoad(compiled.c_str(), config.c_str(), mapped)) {
+                std::fprintf(stderr, "FAIL %d profiles: a load failed\n", profiles);
+                failures++;
+            }
+        }
+        auto row = [rounds](const char* what, auto&& load) {
+            const bench::Timing d = bench::timeOf(rounds, [&load] { load(false); });
+            const bench::Timing m = bench::timeOf(rounds, [&load] { load(true); });
+            std::printf("  %-12s %8.1f / %8.1f | %8.1f / %8.1f\n", what, d.median_us, d.p90_us, m.median_us, m.p90_us);
+        };
+        row("DOM", [&config](bool mapped) { domLoad(config.c_str(), mapped); });
+        row("loadProfile", [&config](bool mapped) { outlineLoad(config.c_str(), mapped); });
+        row("image", [&compiled, &config](bool mapped) { imageLoad(compiled.c_str(), config.c_str(), mapped); });
+    }
+    return failures ? 1 : 0;
+}
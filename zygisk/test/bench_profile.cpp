@@ -0,0 +1,77 @@
+// loadProfile() + viewOf() on the shipped example's profile, against the way the module read
+// it before the arena: the whole document as a DOM, and every value copied - then trimmed -
+// into a std::string of its own. Heap allocations and bytes of one load, and the median and
+// p90 time over ROUNDS.
+//
+//   bench_profile [ROUNDS]
+
+#include "bench.hpp"
+#include "log.hpp"
+#include "profile.hpp"
+#include <json.hpp>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+namespace {
+
+using json = nlohmann::json;
+
+// The keys the old DeviceInfo held a std::string for.
+constexpr const char* kOldKeys[] = {"BRAND", "DEVICE", "MANUFACTURER", "MODEL", "FINGERPRINT", "PRODUCT",
+                                    "BOARD", "BOOTLOADER", "HARDWARE", "ID", "DISPLAY", "HOST", "ODM_SKU",
+                                    "SKU", "USER", "INCREMENTAL", "SECURITY_PATCH", "TIMESTAMP"};
+
+std::string trimmed(const std::string& s) {
+    return std::string(trim(s));
+}
+
+// ifstream, json::parse, device.value() per key and a trimmed copy of each.
+size_t domLoad(const char* path) {
+    std::ifstream file(path);
+    const std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    const json config = json::parse(text, nullptr, false);
+    if (!config.contains(LOG_TAG) || !config[LOG_TAG].is_object()) return 0;
+    const json device = config[LOG_TAG];
+    std::string values[std::size(kOldKeys)];
+    size_t kept = 0;
+    for (size_t k = 0; k < std::size(kOldKeys); k++) {
+        values[k] = trimmed(device.value(kOldKeys[k], ""));
+        kept += !values[k].empty();
+    }
+    return kept;
+}
+
+size_t arenaLoad(const char* path) {
+    DeviceInfo info{};
+    if (!loadProfile(path, info)) return 0;
+    const ProfileView view = viewOf(info);
+    size_t kept = 0;
+    for (const char* s : view.str) kept += s != nullptr;
+    return kept;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const int rounds = argc > 1 ? std::max(1, std::atoi(argv[1])) : 200;
+    const bench::TempFile config("{\n  \"" + std::string(LOG_TAG) + "\": " + bench::exampleProfile() + "\n}\n");
+
+    size_t dom_kept = 0, arena_kept = 0;
+    const bench::Heap dom = bench::heapOf([&] { dom_kept = domLoad(config.c_str()); });
+    const bench::Heap arena = bench::heapOf([&] { arena_kept = arenaLoad(config.c_str()); });
+    const bench::Timing dom_time = bench::timeOf(rounds, [&] { domLoad(config.c_str()); });
+    const bench::Timing arena_time = bench::timeOf(rounds, [&] { arenaLoad(config.c_str()); });
+
+    std::printf("one load of the example profile, %d rounds:\n", rounds);
+    std::printf("  DOM + std::string        %s, median %.1f us, p90 %.1f us\n", bench::heapText(dom).c_str(),
+                dom_time.median_us, dom_time.p90_us);
+    std::printf("  loadProfile + viewOf     %s, median %.1f us, p90 %.1f us\n", bench::heapText(arena).c_str(),
+                arena_time.median_us, arena_time.p90_us);
+    if (dom_kept == 0 || arena_kept == 0) {
+        std::fprintf(stderr, "FAIL the profile did not load\n");
+        return 1;
+    }
+    return 0;
+}
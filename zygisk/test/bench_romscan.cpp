@@ -0,0 +1,83 @@
+// scanRomVersion() against the getline loop it replaced, on synthetic build.props of 1k to
+// 20k lines: the ro.build.version.* block at the top, where a generated build.prop has it,
+// and at the bottom, where the scan has to walk everything. Both must find the same three
+// values. Median and p90 of ROUNDS reads, page cache warm.
+//
+//   bench_romscan [ROUNDS]
+
+#include "bench.hpp"
+#include "profile.hpp"
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+namespace {
+
+// The scan before memmem: every line read into a string, three needles built per line, and
+// no stopping once all three are known.
+RomVersion getlineScan(const char* path) {
+    RomVersion rom;
+    std::ifstream file(path);
+    if (!file.is_open()) return rom;
+    std::string line;
+    while (std::getline(file, line)) {
+        auto take = [&line](const char* key, std::string& out) {
+            const std::string needle = std::string(key) + "=";
+            if (line.rfind(needle, 0) == 0) out = std::string(trim(line.substr(needle.size())));
+        };
+        take("ro.build.version.release", rom.release);
+        take("ro.build.version.codename", rom.codename);
+        std::string sdk;
+        take("ro.build.version.sdk", sdk);
+        if (!sdk.empty()) rom.sdk = std::atoi(sdk.c_str());
+    }
+    return rom;
+}
+
+// `lines` lines of props, the version block first or last. What the other keys look like
+// matters little, except that some share the prefix the scan jumps between.
+std::string buildProp(int lines, bool keys_first) {
+    const std::string block = "ro.build.version.incremental=12701944\n"
+                              "ro.build.version.preview_sdk=0\n"
+                              "ro.build.version.codename=REL\n"
+                              "ro.build.version.all_codenames=REL\n"
+                              "ro.build.version.release=15\n"
+                              "ro.build.version.release_or_codename=15\n"
+                              "ro.build.version.security_patch=2025-01-05\n"
+                              "ro.build.version.sdk=35\n";
+    std::string text = "# begin build properties\n# autogenerated by buildinfo.sh\n";
+    if (keys_first) text += block;
+    for (int i = 0; i < lines - 10; i++) {
+        text += i % 50 == 0 ? "# ro.build.version.sdk is set above\n"
+                            : "ro.vendor.feature." + std::to_string(i) + ".enabled=" + std::to_string(i % 7) + "\n";
+    }
+    if (!keys_first) text += block;
+    return text;
+}
+
+bool same(const RomVersion& a, const RomVersion& b) {
+    return a.release == b.release && a.codename == b.codename && a.sdk == b.sdk && a.sdk == 35;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const int rounds = argc > 1 ? std::max(1, std::atoi(argv[1])) : 200;
+    int failures = 0;
+    std::printf("ROM version from build.prop, %d rounds, median / p90:\n", rounds);
+    for (const bool keys_first : {true, false}) {
+        for (const int lines : {1000, 5000, 10000, 20000}) {
+            const bench::TempFile prop(buildProp(lines, keys_first));
+            if (!same(getlineScan(prop.c_str()), scanRomVersion(prop.c_str()))) {
+                std::fprintf(stderr, "FAIL %d lines: the scans disagree\n", lines);
+                failures++;
+            }
+            const bench::Timing before = bench::timeOf(rounds, [&prop] { getlineScan(prop.c_str()); });
+            const bench::Timing after = bench::timeOf(rounds, [&prop] { scanRomVersion(prop.c_str()); });
+            std::printf("  keys at the %-6s %5d lines: getline %7.1f / %7.1f us, memmem %6.1f / %6.1f us\n",
+                        keys_first ? "top" : "bottom", lines, before.median_us, before.p90_us, after.median_us,
+                        after.p90_us);
+        }
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,404 @@
+// The module on a host: loaded through its Zygisk entry point, fed an image of a fixture
+// config by a companion of its own, and applied through a fake JNIEnv that records every
+// Build field written. Checks the writes for a process on the default profile, one mapped
+// to another and an excluded one - the ROM's own values, scanned here from synthetic
+// build.props as well - and the prop table each of them gets from an image built with
+// props. Then, for every config of CORPUS, times onLoad plus a specialization and counts its
+// JNI calls and heap allocations.
+//
+//   spoof_harness FIXTURE CORPUS [ROUNDS]
+//
+// Nothing under /data/adb is read for the profile: the image comes from FIXTURE, or the
+// config of CORPUS being timed. The version group depends on the host's policy and ROM, so
+// it is left out of the checks. Allocations are counted on glibc without sanitizers only.
+
+#include <cstdint>
+#include <jni.h>
+#include <sys/types.h>
+#include <zygisk.hpp>
+#include "companion.hpp"
+#include "image.hpp"
+#include "bench.hpp"
+#include "stats.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include <dirent.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+using bench::Uncounted;
+
+// JNINativeInterface in the NDK, JNINativeInterface_ in the JDK.
+using Functions = std::remove_const_t<std::remove_pointer_t<decltype(JNIEnv::functions)>>;
+
+// Handles are 1-based indexes into these.
+std::vector<std::string> classes;
+std::vector<std::pair<std::string, std::string>> ids;      // "android/os/Build.MODEL", its signature
+std::deque<std::string> strings;
+std::map<std::string, std::string> written;                // field -> value; numbers in decimal
+size_t calls = 0;
+int failures = 0;
+
+template <typename H>
+size_t indexOf(H handle) {
+    return reinterpret_cast<uintptr_t>(handle) - 1;
+}
+
+template <typename H>
+H handleOf(size_t count) {
+    return reinterpret_cast<H>(static_cast<uintptr_t>(count));
+}
+
+jstring keepString(const char* s) {
+    Uncounted fake;
+    strings.emplace_back(s);
+    return handleOf<jstring>(strings.size());
+}
+
+// A write through the wrong setter is recorded as such, so it fails the checks.
+void record(jfieldID id, char kind, std::string value) {
+    Uncounted fake;
+    calls++;
+    const auto& [field, sig] = ids[indexOf(id)];
+    const char expected = sig[0] == 'L' ? 'L' : sig[0];
+    written[field] = kind == expected ? std::move(value) : "<wrong setter>";
+}
+
+Functions makeFunctions() {
+    Functions f{};
+    f.FindClass = [](JNIEnv*, const char* name) -> jclass {
+        calls++;
+        Uncounted fake;
+        classes.emplace_back(name);
+        return handleOf<jclass>(classes.size());
+    };
+    f.GetStaticFieldID = [](JNIEnv*, jclass cls, const char* name, const char* sig) -> jfieldID {
+        calls++;
+        Uncounted fake;
+        ids.emplace_back(classes[indexOf(cls)] + "." + name, sig);
+        return handleOf<jfieldID>(ids.size());
+    };
+    f.ExceptionCheck = [](JNIEnv*) -> jboolean { return JNI_FALSE; };
+    f.ExceptionClear = [](JNIEnv*) {};
+    f.DeleteLocalRef = [](JNIEnv*, jobject) {};
+    f.NewStringUTF = [](JNIEnv*, const char* s) -> jstring {
+        calls++;
+        return keepString(s);
+    };
+    f.GetStringUTFChars = [](JNIEnv*, jstring s, jboolean*) -> const char* { return strings[indexOf(s)].c_str(); };
+    f.ReleaseStringUTFChars = [](JNIEnv*, jstring, const char*) {};
+    f.SetStaticObjectField = [](JNIEnv*, jclass, jfieldID id, jobject value) {
+        Uncounted fake;
+        record(id, 'L', strings[indexOf(value)]);
+    };
+    f.SetStaticIntField = [](JNIEnv*, jclass, jfieldID id, jint value) {
+        Uncounted fake;
+        record(id, 'I', std::to_string(value));
+    };
+    f.SetStaticLongField = [](JNIEnv*, jclass, jfieldID id, jlong value) {
+        Uncounted fake;
+        record(id, 'J', std::to_string(static_cast<long long>(value)));
+    };
+    return f;
+}
+
+// The fake Zygisk: a companion that serves the fixture's image, and the options set.
+std::vector<char> served;
+std::thread companion;
+Stats reported;
+bool got_report = false;
+bool dlclose = false;
+zygisk::internal::module_abi* module = nullptr;
+
+// The fake companion's thread is Zygisk's cost, not the module's.
+int connectCompanion(void*) {
+    Uncounted fake;
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != 0) return -1;
+    companion = std::thread([fd = fds[1]] {
+        // Asks every process for its stats, as the real one does while tracing.
+        const uint32_t len = static_cast<uint32_t>(served.size());
+        const uint32_t head = len | companion::kReport;
+        if (write(fd, &head, sizeof(head)) == sizeof(head) &&
+            write(fd, served.data(), len) == static_cast<ssize_t>(len)) {
+            got_report = read(fd, &reported, sizeof(reported)) == sizeof(reported);
+        }
+        close(fd);
+    });
+    return fds[0];
+}
+
+bool registerModule(zygisk::internal::api_table*, zygisk::internal::module_abi* abi) {
+    module = abi;
+    return true;
+}
+
+void setOption(void*, zygisk::Option option) {
+    if (option == zygisk::DLCLOSE_MODULE_LIBRARY) dlclose = true;
+}
+
+zygisk::internal::api_table table{};
+Functions functions;
+JNIEnv env{};
+
+// onLoad, then preAppSpecialize for `process`, as zygote would in a fresh child.
+void specialize(const char* process) {
+    classes.clear();
+    ids.clear();
+    strings.clear();
+    written.clear();
+    calls = 0;
+    got_report = false;
+    dlclose = false;
+
+    bench::allocations = 0;
+    bench::counting = true;
+    zygisk_module_entry(&table, &env);
+    jint uid = 10000, gid = 10000, runtime_flags = 0, mount_external = 0;
+    jintArray gids = nullptr;
+    jobjectArray rlimits = nullptr;
+    jstring se_info = nullptr, instruction_set = nullptr, app_data_dir = nullptr;
+    jstring nice_name = keepString(process);
+    zygisk::AppSpecializeArgs args{uid, gid, gids, runtime_flags, rlimits, mount_external, se_info, nice_name,
+                                   instruction_set, app_data_dir, nullptr, nullptr, nullptr, nullptr,
+                                   nullptr, nullptr, nullptr};
+    module->preAppSpecialize(module->impl, &args);
+    bench::counting = false;
+    if (companion.joinable()) companion.join();
+}
+
+void expect(bool ok, const char* process, const std::string& what) {
+    if (ok) return;
+    std::fprintf(stderr, "FAIL %s: %s\n", process, what.c_str());
+    failures++;
+}
+
+void expectField(const char* process, const std::string& field, const char* value) {
+    const auto it = written.find(field);
+    if (!value) {
+        expect(it == written.end(), process, field + " written as \"" + (it == written.end() ? "" : it->second) + "\"");
+    } else {
+        expect(it != written.end() && it->second == value, process,
+               field + " is \"" + (it == written.end() ? "<not written>" : it->second) + "\", not \"" + value + "\"");
+    }
+}
+
+// Every write counted, and the companion told where the profile came from.
+void expectReport(const char* process) {
+    expect(got_report, process, "no stats reported to the companion");
+    expect(reported.source == Source::Companion, process, "profile not taken from the companion");
+    expect(reported.fields == written.size(), process,
+           std::to_string(reported.fields) + " fields reported, " + std::to_string(written.size()) + " written");
+}
+
+constexpr const char* kBuild = "android/os/Build.";
+constexpr const char* kVersion = "android/os/Build$VERSION.";
+
+void checkDefault() {
+    const char* process = "com.example.app";
+    specialize(process);
+    expectReport(process);
+    const std::string b = kBuild, v = kVersion;
+    expectField(process, b + "BRAND", "google");
+    expectField(process, b + "DEVICE", "comet");
+    expectField(process, b + "MODEL", "Pixel 9 Pro Fold");
+    expectField(process, b + "FINGERPRINT", "google/comet/comet:15/AP4A.250105.002/12701944:user/release-keys");
+    expectField(process, b + "ODM_SKU", "comet");
+    expectField(process, b + "SKU", "comet");
+    expectField(process, b + "TAGS", "release-keys");
+    expectField(process, b + "TYPE", "user");
+    expectField(process, b + "TIME", "1733791200000");
+    expectField(process, b + "BOOTLOADER", nullptr);
+    expectField(process, v + "INCREMENTAL", "12701944");
+    expectField(process, v + "SECURITY_PATCH", "2025-01-05");
+    expect(dlclose, process, "library kept loaded with no props hooked");
+}
+
+// By package, and by the package of one of its processes. Nothing of "COPG-VD" leaks in.
+void checkMapped() {
+    for (const char* process : {"com.example.mapped", "com.example.mapped:remote"}) {
+        specialize(process);
+        expectReport(process);
+        const std::string b = kBuild;
+        expectField(process, b + "BRAND", "samsung");
+        expectField(process, b + "MODEL", "SM-S928B");
+        expectField(process, b + "ODM_SKU", "e3q_eur");
+        expectField(process, b + "SKU", "qcom");
+        expectField(process, b + "FINGERPRINT", nullptr);
+        expectField(process, b + "TIME", nullptr);
+    }
+}
+
+// The ROM's own Build, whatever this host's build.props give - on most, nothing - and not a
+// field of any profile.
+void checkExcluded() {
+    const char* process = "com.example.excluded";
+    DeviceInfo real{};
+    scanRomBuild(real);
+    const ProfileView rom = viewOf(real);
+    specialize(process);
+    expectReport(process);
+    for (size_t f = 0; f < kFieldCount; f++) {
+        const BuildField& field = kBuildFields[f];
+        const std::string name = std::string(field.cls == Cls::Build ? kBuild : kVersion) + field.name;
+        const std::string num = std::to_string(rom.num[f]);
+        expectField(process, name, field.kind == Kind::Str ? rom.str[f] : rom.num[f] ? num.c_str() : nullptr);
+    }
+    expect(dlclose, process, "library kept loaded");
+}
+
+// The scan behind it, on a build.prop split the way Android 10 and later split it: the
+// product keys only in each partition's own name, the fingerprint left for init to derive.
+void checkRomBuild() {
+    const char* what = "scanRomBuild";
+    const bench::TempFile system("ro.build.id=BP2A.250605.031\n"
+                                 "ro.build.display.id=BP2A.250605.031 release-keys\n"
+                                 "ro.build.version.incremental=13487213\n"
+                                 "ro.build.version.sdk=36\n"
+                                 "ro.build.version.sdk_full=36.1\n"
+                                 "ro.build.version.codename=REL\n"
+                                 "ro.build.version.release=16\n"
+                                 "ro.build.type=user\n"
+                                 "ro.build.tags=release-keys\n"
+                                 "ro.build.date.utc=1749081600\n"
+                                 "ro.product.system.brand=generic\n"
+                                 "ro.product.system.model=mainline\n"
+                                 "ro.product.model_for_attestation=nope\n");
+    const bench::TempFile vendor("ro.product.vendor.brand=google\n"
+                                 "ro.product.vendor.device=tokay\n"
+                                 "ro.product.vendor.name=tokay\n"
+                                 "ro.product.board=tokay\n");
+    DeviceInfo real{};
+    scanRomBuild(real, system.c_str(), vendor.c_str());
+    const ProfileView rom = viewOf(real);
+    // By name at run time: fieldOf() is for constants only.
+    auto slot = [](const char* field) {
+        size_t f = 0;
+        while (f + 1 < kFieldCount && strcmp(kBuildFields[f].name, field) != 0) f++;
+        return f;
+    };
+    auto expectStr = [&rom, &slot, what](const char* field, const char* value) {
+        const char* got = rom.str[slot(field)];
+        expect(got && !strcmp(got, value), what, std::string(field) + " is \"" + (got ? got : "<blank>") + "\"");
+    };
+    auto expectNum = [&rom, &slot, what](const char* field, int64_t value) {
+        const int64_t got = rom.num[slot(field)];
+        expect(got == value, what, std::string(field) + " is " + std::to_string(got));
+    };
+    expectStr("BRAND", "google");
+    expectStr("MODEL", "mainline");
+    expectStr("PRODUCT", "tokay");
+    expectStr("BOARD", "tokay");
+    expectStr("DISPLAY", "BP2A.250605.031 release-keys");
+    expectStr("FINGERPRINT", "google/tokay/tokay:16/BP2A.250605.031/13487213:user/release-keys");
+    expectStr("RELEASE_OR_CODENAME", "16");
+    expectStr("SDK", "36");
+    expectNum("SDK_INT", 36);
+    expectNum("SDK_INT_FULL", 3600001);
+    expectNum("TIME", 1749081600000);
+}
+
+// The value `process`'s prop table gives `name`, probed as prophook does; nullptr when the
+// table does not have it, or the process gets none.
+const char* servedProp(const image::Header& h, const char* process, const char* name) {
+    const image::Record* record = image::recordOf(h, process);
+    const image::PropSlot* table = record ? image::propsOf(h, *record) : nullptr;
+    if (!table) return nullptr;
+    const char* text = reinterpret_cast<const char*>(table + record->props.slots);
+    const uint32_t hash = image::propHash(name, strlen(name));
+    const uint32_t mask = record->props.slots - 1;
+    for (uint32_t i = hash & mask;; i = (i + 1) & mask) {
+        if (table[i].name == image::kEmpty) return nullptr;
+        if (table[i].hash == hash && !strcmp(text + table[i].name, name)) return text + table[i].value;
+    }
+}
+
+// A process serves the props of the profile its Build fields come from, never the default's.
+void checkPropTables(const char* fixture) {
+    const image::PropTables tables = {
+        {"", {{"ro.product.model", "Pixel 9 Pro Fold"}, {"ro.build.tags", "release-keys"}}},
+        {"s24", {{"ro.product.model", "SM-S928B"}}},
+    };
+    std::vector<char> bytes;
+    const image::Header* h = image::build(fixture, bytes, &tables) ? image::check(bytes.data(), bytes.size()) : nullptr;
+    expect(h != nullptr, fixture, "no intact image with prop tables");
+    if (!h) return;
+    auto expectProp = [h](const char* process, const char* name, const char* value) {
+        const char* got = servedProp(*h, process, name);
+        const bool ok = value ? got && !strcmp(got, value) : !got;
+        expect(ok, process, std::string(name) + " served as \"" + (got ? got : "<nothing>") + "\"");
+    };
+    expectProp("com.example.app", "ro.product.model", "Pixel 9 Pro Fold");
+    expectProp("com.example.app", "ro.build.tags", "release-keys");
+    expectProp("com.example.mapped:remote", "ro.product.model", "SM-S928B");
+    expectProp("com.example.mapped:remote", "ro.build.tags", nullptr);
+    expectProp("com.example.excluded", "ro.product.model", nullptr);
+}
+
+// onLoad and the whole specialization, the companion's answer included, for the image of
+// `config`.
+void timeConfig(const std::string& config, int rounds) {
+    if (!image::build(config.c_str(), served)) {
+        expect(false, config.c_str(), "no image");
+        return;
+    }
+    const bench::Timing t = bench::timeOf(rounds, [] { specialize("com.example.app"); });
+    const std::string name = config.substr(config.rfind('/') + 1);
+    const std::string allocated = bench::kCountsAllocations ? std::to_string(bench::allocations) : "n/a";
+    std::printf("%-14s median %.1f us, p90 %.1f us, %zu JNI calls, %s allocations, %zu fields, %zu image bytes\n",
+                name.c_str(), t.median_us, t.p90_us, calls, allocated.c_str(), written.size(), served.size());
+}
+
+// The .json files of `dir`, by name.
+std::vector<std::string> corpus(const char* dir) {
+    std::vector<std::string> configs;
+    if (DIR* d = opendir(dir)) {
+        while (const dirent* e = readdir(d)) {
+            const std::string name = e->d_name;
+            if (name.size() > 5 && name.compare(name.size() - 5, 5, ".json") == 0) configs.push_back(std::string(dir) + "/" + name);
+        }
+        closedir(d);
+    }
+    std::sort(configs.begin(), configs.end());
+    return configs;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::fprintf(stderr, "usage: spoof_harness FIXTURE CORPUS [ROUNDS]\n");
+        return 2;
+    }
+    if (!image::build(argv[1], served)) return 1;
+
+    functions = makeFunctions();
+    env.functions = &functions;
+    table.registerModule = registerModule;
+    table.connectCompanion = connectCompanion;
+    table.setOption = setOption;
+
+    checkDefault();
+    checkMapped();
+    checkExcluded();
+    checkRomBuild();
+    checkPropTables(argv[1]);
+    const int rounds = argc > 3 ? std::max(1, std::atoi(argv[3])) : 200;
+    const std::vector<std::string> configs = corpus(argv[2]);
+    expect(!configs.empty(), argv[2], "no configs to time");
+    std::printf("onLoad + preAppSpecialize of com.example.app over %d rounds:\n", rounds);
+    for (const std::string& config : configs) timeConfig(config, rounds);
+
+    if (failures) std::fprintf(stderr, "%d checks failed\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,71 @@
+#include "trace.hpp"
+#include "io.hpp"
+#include "profile.hpp"
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace trace {
+
+namespace {
+
+int marker = -1;
+int pid = 0;
+bool flagged = false;
+
+// snprintf's result is what it wanted to write: a long name is cut, but keeps its '\n'.
+template <size_t N>
+void emit(char (&buf)[N], int len) {
+    if (len <= 0) return;
+    if (static_cast<size_t>(len) >= N) {
+        len = N - 1;
+        buf[len - 1] = '\n';
+    }
+    write(marker, buf, static_cast<size_t>(len));
+}
+
+} // namespace
+
+void start() {
+    if (marker >= 0) return;
+    io::UniqueFd flag(io::openRead(trace_flag_file));
+    flagged = static_cast<bool>(flag);
+    if (!flagged) return;
+    char buf[256];
+    std::string_view line(buf, io::readFull(flag.get(), buf, sizeof(buf) - 1));
+    line = trim(line.substr(0, line.find('\n')));
+    std::string path(line);
+    if (path.empty()) {
+        path = access("/sys/kernel/tracing/trace_marker", W_OK) == 0
+             ? "/sys/kernel/tracing/trace_marker" : "/sys/kernel/debug/tracing/trace_marker";
+    }
+    // O_APPEND does nothing to tracefs and keeps slices whole in an ordinary file.
+    marker = open(path.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+    pid = getpid();
+}
+
+void stop() {
+    if (marker < 0) return;
+    close(marker);
+    marker = -1;
+}
+
+bool enabled() {
+    return flagged;
+}
+
+void begin(const char* name) {
+    if (marker < 0) return;
+    char buf[128];
+    emit(buf, snprintf(buf, sizeof(buf), "B|%d|COPG-VD %s\n", pid, name));
+}
+
+void end() {
+    if (marker < 0) return;
+    char buf[32];
+    emit(buf, snprintf(buf, sizeof(buf), "E|%d\n", pid));
+}
+
+} // namespace trace
@@ -0,0 +1,31 @@
+#pragma once
+
+// Begin/end slices on the kernel's trace_marker, in the "B|pid|name" / "E|pid" form atrace
+// and perfetto read, so the module shows up inside zygote's window of a boot trace.
+//
+// Off unless trace_flag_file exists. Its first line, when there is one, is the marker to
+// write to instead of tracefs' - any writable file will do, which is how it is checked
+// on a host. Off, every call below is a test of one int.
+static constexpr const char* trace_flag_file = "/data/adb/modules/COPG-VD/.trace";
+
+namespace trace {
+
+// Opens the marker if the flag file asks for it. Once per process, before the first slice.
+void start();
+// Closes it again: the fd must not outlive the work it traces in an app process.
+void stop();
+// Whether start() found trace_flag_file.
+bool enabled();
+
+void begin(const char* name);
+void end();
+
+class Scope {
+public:
+    explicit Scope(const char* name) { begin(name); }
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+    ~Scope() { end(); }
+};
+
+} // namespace trace